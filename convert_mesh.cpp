@@ -0,0 +1,146 @@
+#include "che_io.h"
+#include "che_bin.h"
+#include "che_stream.h"
+
+using namespace std;
+using namespace gproshan;
+
+int main(int nargs, const char ** args)
+{
+	if(nargs < 2)
+	{
+		printf("./convert_mesh [--reorder morton|rcm] [mesh_paths.(off,obj,ply,gpz)]\n");
+		printf("  writes the native binary file mesh_path.che next to each input mesh. With --reorder the\n");
+		printf("  vertices are sorted by a Morton curve or the Reverse Cuthill-McKee order, and the faces\n");
+		printf("  by their minimum new vertex, the vertex indexes of the che file differ from the input.\n");
+		printf("./convert_mesh --check [mesh_paths.che]\n");
+		printf("  verifies the hash and the topology tables of each che file.\n");
+		printf("./convert_mesh --stream <block_size> [mesh_paths.(che,off,obj,ply,gpz)]\n");
+		printf("  writes the out-of-core blocks of each mesh in the directory mesh_path.stream, about\n");
+		printf("  block_size vertices by block. A che file is paged from the disk, the work arrays of\n");
+		printf("  the partition are O(n_vertices + n_faces) indexes in memory.\n");
+		return 0;
+	}
+
+	if(string(args[1]) == "--stream" && nargs > 2)
+	{
+		const size_t block_size = atoll(args[2]);
+
+		int n_failed = 0;
+		for(int i = 3; i < nargs; i++)
+		{
+			string file = args[i];
+			size_t pos = file.rfind('.');
+
+			che * mesh = load_mesh(file);
+			if(!mesh)
+			{
+				fprintf(stderr, "unsupported mesh format: %s\n", file.c_str());
+				continue;
+			}
+
+			double save_time;
+			bool saved;
+			TIC(save_time) saved = che_stream::write_file(mesh, file.substr(0, pos) + ".stream", block_size); TOC(save_time)
+
+			if(!saved)
+			{
+				fprintf(stderr, "write error: %s.stream\n", file.substr(0, pos).c_str());
+				n_failed++;
+				delete mesh;
+				continue;
+			}
+
+			che_stream stream(file.substr(0, pos) + ".stream");
+			printf("%s: %lu vertices, %lu faces, saved %lu blocks in %s.stream %.3lfs\n",
+					file.c_str(), mesh->n_vertices(), mesh->n_faces(), stream.n_blocks(), file.substr(0, pos).c_str(), save_time);
+
+			delete mesh;
+		}
+
+		return n_failed ? 1 : 0;
+	}
+
+	if(string(args[1]) == "--check")
+	{
+		int n_corrupt = 0;
+		for(int i = 2; i < nargs; i++)
+		{
+			double load_time;
+			che_bin * mesh = nullptr;
+
+			TIC(load_time) mesh = new che_bin(args[i], true); TOC(load_time)
+
+			const bool ok = mesh->n_vertices() > 0;
+			n_corrupt += !ok;
+
+			printf("%s: %s, %lu vertices, %lu faces, %.3lfs\n", args[i], ok ? "ok" : "corrupt", mesh->n_vertices(), mesh->n_faces(), load_time);
+
+			delete mesh;
+		}
+
+		return n_corrupt ? 1 : 0;
+	}
+
+	int first = 1;
+	bool reorder = false;
+	che::reorder_t order = che::MORTON;
+
+	if(string(args[1]) == "--reorder" && nargs > 2)
+	{
+		const string opt = args[2];
+		if(opt != "morton" && opt != "rcm")
+		{
+			fprintf(stderr, "unknown order: %s, use morton or rcm\n", args[2]);
+			return 1;
+		}
+
+		reorder = true;
+		order = opt == "rcm" ? che::RCM : che::MORTON;
+		first = 3;
+	}
+
+	int n_failed = 0;
+	for(int i = first; i < nargs; i++)
+	{
+		string file = args[i];
+		size_t pos = file.rfind('.');
+
+		double load_time;
+		che * mesh = nullptr;
+
+		TIC(load_time) mesh = load_mesh(file); TOC(load_time)
+
+		if(!mesh)
+		{
+			fprintf(stderr, "unsupported mesh format: %s\n", file.c_str());
+			continue;
+		}
+
+		double reorder_time = 0;
+		if(reorder)
+		{
+			TIC(reorder_time) delete [] mesh->reorder(order); TOC(reorder_time)
+		}
+
+		double save_time;
+		bool saved;
+		TIC(save_time) saved = che_bin::write_file(mesh, file.substr(0, pos)); TOC(save_time)
+
+		if(!saved)
+		{
+			fprintf(stderr, "write error: %s.che\n", file.substr(0, pos).c_str());
+			n_failed++;
+			delete mesh;
+			continue;
+		}
+
+		printf("%s: %lu vertices, %lu faces, load %.3lfs, reorder %.3lfs, saved %s.che %.3lfs\n",
+				file.c_str(), mesh->n_vertices(), mesh->n_faces(), load_time, reorder_time, file.substr(0, pos).c_str(), save_time);
+
+		delete mesh;
+	}
+
+	return n_failed ? 1 : 0;
+}
+
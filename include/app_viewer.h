@@ -7,6 +7,9 @@
 #include "che_obj.h"
 #include "che_ply.h"
 #include "che_img.h"
+#include "che_bin.h"
+#include "che_gpz.h"
+#include "che_io.h"
 #include "laplacian.h"
 #include "che_off.h"
 #include "dijkstra.h"
@@ -6,6 +6,9 @@
 
 #include <vector>
 #include <string>
+#include <cstdint>
+#include <memory>
+#include <atomic>
 
 #define for_star(he, mesh, v) for(index_t stop = mesh->evt(v), he = mesh->evt(v); he != NIL; he = (he = mesh->ot(prev(he))) != stop ? he : NIL)
 #define for_border(he, mesh, v) for(index_t stop = mesh->evt(v), he = mesh->evt(v); he != NIL; he = (he = mesh->evt(mesh->vt(next(he)))) != stop ? he : NIL)
@@ -18,6 +21,46 @@ namespace gproshan {
 typedef std::vector<index_t> star_t;		// star (vector of he)
 typedef std::vector<index_t> link_t;		// link (vector of he)
 
+/// Read only view of a precomputed range of indexes (rings of a vertex), it does not allocate memory.
+struct ring_t
+{
+	const index_t * first;
+	const index_t * last;
+
+	const index_t * begin() const { return first; }
+	const index_t * end() const { return last; }
+	size_t size() const { return last - first; }
+	const index_t & operator [] (const index_t & i) const { return first[i]; }
+};
+
+/// Reusable workspace of che::compute_toplesets, the buffers are allocated only when the number of vertices grows.
+struct toplesets_ws_t
+{
+	index_t * toplesets = nullptr;		///< v -> level, NIL if v was not reached
+	index_t * sorted = nullptr;			///< vertices sorted by level
+	std::vector<index_t> limits;		///< level l in sorted[limits[l], limits[l + 1])
+	uint64_t * visited = nullptr;		///< bitmap of the reached vertices
+	uint64_t * frontier = nullptr;		///< bitmap of the current level (bottom-up steps)
+	size_t n_vertices = 0;
+
+	toplesets_ws_t() = default;
+	toplesets_ws_t(const toplesets_ws_t &) = delete;
+	~toplesets_ws_t();
+	void resize(const size_t & n);
+};
+
+/// Batch of topology edits of a che mesh, collected by the caller and applied together by che::commit.
+struct edit_t
+{
+	std::vector<index_t> removed_vertices;	///< the faces incident to the removed vertices are removed too
+	std::vector<index_t> removed_faces;
+	std::vector<vertex> new_vertices;		///< the i-th new vertex has the index n_vertices() + i in new_faces
+	std::vector<index_t> new_faces;			///< P vertices by face
+
+	std::vector<index_t> vertex_map;		///< output of commit	: old v -> new v, NIL if it was removed
+	std::vector<index_t> face_map;			///< output of commit	: old t -> new t, NIL if it was removed
+};
+
 index_t trig(const index_t & he);
 index_t next(const index_t & he);
 index_t prev(const index_t & he);
@@ -29,6 +72,10 @@ class che
 	public:
 		static const size_t P = 3;
 
+		enum reorder_t {	MORTON,		///< Morton (Z-order) curve of the vertex positions
+							RCM			///< Reverse Cuthill-McKee order of the vertices graph
+						};
+
 	protected:
 		std::string filename_;
 
@@ -46,16 +93,40 @@ class che
 		index_t * EHT;	///< extra half edge table	: he	-> e
 		index_t * BT;	///< boundary table			: b 	-> v
 
+		std::atomic<index_t *> RO;	///< rings offsets (lazy)	: v	-> i, rings of v in [RO[v], RO[v + 1]), published last (release)
+		index_t * RV;	///< rings vertices			: i		-> v, one ring vertices (link vertices)
+		index_t * RL;	///< rings link				: i		-> he, link he as link()
+		index_t * RS;	///< rings star				: i		-> he, star he of the link he (NIL border)
+
+		area_t * FA;	///< face areas (cache)		: t		-> area
+		vertex * FN;	///< face normals (cache)	: t		-> unit normal
+		area_t * VA;	///< vertex areas (cache)	: v		-> area
+		vertex * VN;	///< vertex normals (cache)	: v		-> unit normal
+		std::atomic<bool> dirty;	///< geometry changed, the attributes caches must be updated
+
+		// owners of the tables shared with copies of the mesh or borrowed from the caller (copy on write),
+		// they are empty (use_count() == 0) if the tables are owned by the mesh
+		mutable std::shared_ptr<void> shared_gt;	///< GT
+		mutable std::shared_ptr<void> shared_vt;	///< VT
+		mutable std::shared_ptr<void> shared_ot;	///< OT, EVT, ET, EHT, BT
+
+		mutable char * arena = nullptr;		///< single aligned block storing the owned tables (see alloc_tables)
+		mutable size_t arena_size = 0;		///< arena capacity in bytes
+
 		bool manifold;
 
 	public:
 		che(const size_t & n_v = 0, const size_t & n_f = 0);
-		che(const vertex * vertices, const index_t & n_v, const index_t * faces, const index_t & n_f);
+		che(const vertex * vertices, const size_t & n_v, const index_t * faces, const size_t & n_f);
+		che(const vertex * vertices, const size_t & n_v, const index_t * faces, const size_t & n_f, const bool & borrow);
 		che(const che & mesh);		
 		virtual ~che();
 		
 		void star(star_t & s, const index_t & v);
 		void link(link_t & l, const index_t & v);
+		ring_t star(const index_t & v);
+		ring_t link(const index_t & v);
+		ring_t ring(const index_t & v);
 		void border(std::vector<index_t> & border, const index_t & b);
 		bool is_border_v(const index_t & v) const;
 		bool is_border_e(const index_t & e) const;
@@ -67,6 +138,7 @@ class che
 		area_t area_surface() const;
 		vertex normal_he(const index_t & he) const;
 		vertex normal(const index_t & v);
+		const vertex & normal_trig(const index_t & t);
 		vertex gradient_he(const index_t & he, const distance_t *const & f) const;
 		vertex gradient(const index_t & v, const distance_t *const & f);
 		vertex barycenter(const index_t & t) const;
@@ -96,6 +168,10 @@ class che
 		const size_t & n_edges() const;
 		const size_t & n_borders() const;
 		size_t max_degree() const;
+		void edit_vertices();
+
+		/// Vertex v to be edited. Each call marks the attributes caches (normals, areas) dirty, so a
+		/// reference must not be kept across a read of the caches: get_vertex again for the next write.
 		vertex & get_vertex(index_t v);
 		void set_vertices(const vertex *const& positions, size_t n = 0, const index_t & v_i = 0);
 		void set_filename(const std::string & f);
@@ -105,18 +181,24 @@ class che
 		const std::string name_size() const;
 		void reload();
 		void compute_toplesets(index_t *& rings, index_t *& sorted, std::vector<index_t> & limites, const std::vector<index_t> & sources, const index_t & k = NIL);
+		void compute_toplesets(toplesets_ws_t & ws, const std::vector<index_t> & sources, const index_t & k = NIL);
 		void multiplicate_vertices();
 		void remove_non_manifold_vertices();
 		void remove_vertices(const std::vector<index_t> & vertices);
+		void commit(edit_t & edit);
 		void merge(const che * mesh, const std::vector<index_t> & com_vertices);
 		void set_head_vertices(index_t * head, const size_t & n);
+		index_t * reorder(const reorder_t & opt = MORTON);
 		index_t link_intersect(const index_t & v_a, const index_t & v_b);
 		corr_t * edge_collapse(const index_t *const & sort_edges, const vertex *const & normals);
 		corr_t find_corr(const vertex & v, const vertex & n, const std::vector<index_t> & triangles);
 
 	protected:
-		void delete_me();
-		void init(const vertex * vertices, const index_t & n_v, const index_t * faces, const index_t & n_f);
+		virtual void delete_me();
+		void delete_tables();
+		void delete_rings();
+		void delete_attributes();
+		void init(const vertex * vertices, const size_t & n_v, const index_t * faces, const size_t & n_f);
 		void init(const std::string & file);
 		void init(const size_t & n_v, const size_t & n_f);
 		virtual void read_file(const std::string & file);
@@ -125,8 +207,20 @@ class che
 		void update_evt_ot_et();
 		void update_eht();
 		void update_bt();
+		void update_rings();
+		const index_t * rings_offsets();
+		void update_attributes();
+		void alloc_tables();
+		bool in_arena(const void * p) const;
+		void share() const;
+		void share_tables() const;
+		void detach_gt();
+		void detach_vt();
+		void detach_ot();
 
 	friend struct CHE;
+	friend class che_bin;
+	friend class che_soa;
 };
 
 struct vertex_cu;
@@ -0,0 +1,68 @@
+#ifndef CHE_BIN_H
+#define CHE_BIN_H
+
+#include "che.h"
+
+#include <cstdint>
+
+
+// geometry processing and shape analysis framework
+namespace gproshan {
+
+
+/*!
+	Native binary mesh file (.che). It stores all the che tables (GT, VT, OT, EVT, ET, EHT, BT) and
+	the header metadata, the file is memory mapped and the che tables point directly to the mapped
+	pages, so that loading a mesh does not parse data nor rebuild the topology.
+	The mapping is private and shared by the copies of the mesh, it is unmapped by the last one.
+	Editing the mesh copies the edited tables (copy on write), it never modifies the file.
+	The load only checks the header, the tables are checked with verify (O(size of the file)).
+*/
+class che_bin : public che
+{
+	public:
+		struct header_t
+		{
+			char magic[8];					///< "GPROSHAN"
+			uint32_t version;
+			uint32_t size_index;			///< sizeof(index_t) used to write the file
+			uint32_t size_real;				///< sizeof(real_t) used to write the file
+			uint32_t manifold;
+			uint64_t n_vertices;
+			uint64_t n_faces;
+			uint64_t n_half_edges;
+			uint64_t n_edges;
+			uint64_t n_borders;
+			uint64_t hash;					///< hash of all the tables, see che_bin::hash
+			uint64_t offset[7];				///< file offsets of GT, VT, OT, EVT, ET, EHT, BT
+		};
+
+		static const uint32_t version = 2;
+		static const size_t align = 64;		///< tables alignment in the file (cache line)
+
+	private:
+		bool check;
+
+	public:
+		che_bin(const std::string & file, const bool & check_ = false);
+		che_bin(const che_bin & mesh);
+		virtual ~che_bin();
+
+		static bool write_file(const che * mesh, const std::string & file);
+		static bool read_header(header_t & header, const std::string & file);
+
+		/// FNV-1a of the 64 bits words of the tables by blocks, the blocks are hashed in parallel.
+		static uint64_t hash(const che * mesh);
+
+		/// The hash of the tables is hash and the topology tables reference valid elements.
+		static bool verify(const che * mesh, const uint64_t & hash);
+
+	private:
+		void read_file(const std::string & file);
+};
+
+
+} // namespace gproshan
+
+#endif // CHE_BIN_H
+
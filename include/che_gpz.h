@@ -0,0 +1,54 @@
+#ifndef CHE_GPZ_H
+#define CHE_GPZ_H
+
+#include "che.h"
+
+#include <cstdint>
+
+
+// geometry processing and shape analysis framework
+namespace gproshan {
+
+
+/*!
+	Compressed mesh file (.gpz) for archival and shipping, without external dependencies.
+	The faces are coded in a traversal of the half edge structure (OT): each gate (a half edge of a
+	coded face) codes if its opposite face is the next one and its tip vertex as a new vertex, a
+	vertex of the coded border next to the gate (Edgebreaker L and R cases) or a back reference.
+	The coordinates are quantized to bits bits by axis in the bounding box and the new vertices are
+	predicted by the parallelogram rule. All the symbols are coded with an adaptive binary range
+	coder. The vertices and faces are stored in traversal order, so they are renumbered.
+*/
+class che_gpz : public che
+{
+	public:
+		struct header_t
+		{
+			char magic[8];					///< "GPMESHZ"
+			uint32_t version;
+			uint32_t bits;					///< quantization bits by axis
+			uint64_t n_vertices;
+			uint64_t n_faces;
+			double min[3];					///< dequantization: min + q * step
+			double step[3];
+			uint64_t size;					///< bytes of the coded stream
+		};
+
+		static const uint32_t version = 1;
+
+		che_gpz(const std::string & file);
+		che_gpz(const che_gpz & mesh);
+		virtual ~che_gpz() = default;
+
+		/// Max error by axis: half the step, bounding box size / (2^bits - 1) / 2.
+		static bool write_file(const che * mesh, const std::string & file, const unsigned int & bits = 16);
+
+	private:
+		void read_file(const std::string & file);
+};
+
+
+} // namespace gproshan
+
+#endif // CHE_GPZ_H
+
@@ -14,7 +14,7 @@ class che_img : public che
 		che_img(const std::string & file);
 		che_img(const che_img & mesh);
 		virtual ~che_img();
-		void write_file(const std::string & file) const;
+		bool write_file(const std::string & file) const;
 
 	private:
 		void read_file(const std::string & file);
@@ -0,0 +1,57 @@
+#ifndef CHE_IO_H
+#define CHE_IO_H
+
+#include "che.h"
+
+#include <string>
+#include <vector>
+#include <functional>
+
+
+// geometry processing and shape analysis framework
+namespace gproshan {
+
+
+/*!
+	Registry of the mesh file formats. A file is read by the format whose magic bytes match the
+	beginning of the file or, if none matches, by its extension (case insensitive). The built in
+	formats are off, obj, ply, che (che_bin), gpz (che_gpz) and img (che_img, read only), new formats
+	are added with register_format.
+*/
+struct che_format_t
+{
+	std::string name;									///< format name, as in write_mesh
+	std::vector<std::string> extensions;				///< lower case, without the dot
+	std::vector<std::string> magics;					///< file prefixes, empty if the format has not magic bytes
+	std::function<che * (const std::string &)> read;
+	std::function<bool (const che *, const std::string &)> write;	///< file without extension, empty if read only, false if the file is not completely written
+};
+
+/// Adds a format, it replaces a registered format with the same name.
+void register_format(const che_format_t & format);
+
+const std::vector<che_format_t> & formats();
+
+/// Format of a file to read: magic bytes, then extension. nullptr if it is unknown.
+const che_format_t * find_format(const std::string & file);
+
+/// Format by name, nullptr if it is unknown.
+const che_format_t * format_by_name(const std::string & name);
+
+/// Reads a mesh with the format detected by find_format, nullptr if it is unknown.
+che * load_mesh(const std::string & file);
+
+/// Reads the meshes concurrently, a thread by file (at most max_threads at the same time, 0 the
+/// number of cores) and the cores split among them for the parallel parsers.
+/// meshes[i] is nullptr if the format of files[i] is unknown.
+std::vector<che *> load_meshes(const std::vector<std::string> & files, size_t max_threads = 0);
+
+/// Writes file.<extension> with the format name, false if it is unknown, read only or the file is not
+/// completely written (e.g. full disk).
+bool write_mesh(const che * mesh, const std::string & file, const std::string & format);
+
+
+} // namespace gproshan
+
+#endif // CHE_IO_H
+
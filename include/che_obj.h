@@ -10,12 +10,20 @@ namespace gproshan {
 
 class che_obj : public che
 {
+	private:
+		bool attributes;
+		std::vector<vertex> normals_;		///< v -> normal (vn) of the first face corner of v, empty if it is not loaded
+		std::vector<vertex> texcoords_;		///< v -> texture coordinates (vt) u, v, w of the first face corner of v
+
 	public:
-		che_obj(const std::string & file);
+		che_obj(const std::string & file, const bool & attributes_ = false);
 		che_obj(const che_obj & mesh);
 		virtual ~che_obj() = default;
 
-		static void write_file(const che * mesh, const std::string & file);
+		const std::vector<vertex> & normals() const;
+		const std::vector<vertex> & texcoords() const;
+
+		static bool write_file(const che * mesh, const std::string & file);
 
 	private:
 		void read_file(const std::string & file);
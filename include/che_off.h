@@ -15,7 +15,7 @@ class che_off : public che
 		che_off(const che_off & mesh);
 		virtual ~che_off();
 
-		static void write_file(const che * mesh, const std::string & file);
+		static bool write_file(const che * mesh, const std::string & file);
 
 	private:
 		void read_file(const std::string & file);
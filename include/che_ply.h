@@ -10,12 +10,20 @@ namespace gproshan {
 
 class che_ply : public che
 {
+	private:
+		bool attributes;
+		std::vector<vertex> normals_;		///< v -> normal (nx, ny, nz), empty if it is not loaded
+		std::vector<vertex> colors_;		///< v -> color (red, green, blue) in [0, 1], empty if it is not loaded
+
 	public:
-		che_ply(const std::string & file);
+		che_ply(const std::string & file, const bool & attributes_ = false);
 		che_ply(const che_ply & mesh);
 		virtual ~che_ply() = default;
 
-		static void write_file(const che * mesh, const std::string & file);
+		const std::vector<vertex> & normals() const;
+		const std::vector<vertex> & colors() const;
+
+		static bool write_file(const che * mesh, const std::string & file);
 
 	private:
 		void read_file(const std::string & file);
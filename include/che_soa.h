@@ -0,0 +1,59 @@
+#ifndef CHE_SOA_H
+#define CHE_SOA_H
+
+#include "che.h"
+
+
+// geometry processing and shape analysis framework
+namespace gproshan {
+
+
+/*!
+	Structure of arrays (SoA) view of the geometry of a che mesh: the x, y, z coordinates are stored
+	in separated arrays, aligned to the cache line and padded, so that the batch kernels computing
+	per face quantities (areas, normals, cotangents and qualities) can be vectorized.
+	The kernels are omp simd loops compiled for AVX-512, AVX2 and the scalar fallback (x86-64 with
+	gcc or clang), the version is selected at run time for the host cpu.
+	The topology is read from the mesh on each call, after editing the vertex positions update()
+	must be called.
+*/
+class che_soa
+{
+	public:
+		static const size_t align = 64;		///< arrays alignment (cache line)
+
+	private:
+		const che * mesh;
+		size_t n_vertices;
+		size_t n_padded;					///< n_vertices padded to a multiple of the SIMD width
+
+		real_t * X;
+		real_t * Y;
+		real_t * Z;
+
+	public:
+		che_soa(const che * mesh_);
+		che_soa(const che_soa &) = delete;
+		~che_soa();
+
+		void update();
+
+		const real_t * x() const;
+		const real_t * y() const;
+		const real_t * z() const;
+
+		void area_trigs(area_t * areas) const;		///< areas[t]	: n_faces
+		void normal_trigs(vertex * normals) const;	///< normals[t]	: n_faces, unit normals
+		void cotans(real_t * cot) const;			///< cot[he]	: n_half_edges, as che::cotan
+		void pdetriqs(real_t * q) const;			///< q[t]		: n_faces, as che::pdetriq
+		real_t mean_edge() const;
+
+	private:
+		void delete_me();
+};
+
+
+} // namespace gproshan
+
+#endif // CHE_SOA_H
+
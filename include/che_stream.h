@@ -0,0 +1,102 @@
+#ifndef CHE_STREAM_H
+#define CHE_STREAM_H
+
+#include "che.h"
+#include "laplacian.h"
+
+#include <list>
+#include <memory>
+
+
+// geometry processing and shape analysis framework
+namespace gproshan {
+
+
+/*!
+	Out-of-core (streaming) mode for meshes that do not fit in memory. The mesh is partitioned in
+	spatial blocks (cells of a regular grid of the bounding box), each block owns the vertices inside
+	its cell and stores the faces of their stars (one ring halo), so that any per vertex or per face
+	computation of an owned vertex can be done with the block alone.
+	The blocks are written in a directory as native binary meshes (.che, memory mapped) with a map of
+	the local vertices to the global ones, and they are loaded on demand through a LRU cache of
+	cache_size blocks. Only the per vertex arrays (owner and local index) are kept in memory.
+	In a block the owned vertices are the first n_owned local vertices, sorted by global index, and
+	the faces keep the global order, so the stars of the owned vertices are the same of the full mesh.
+	The blocks are validated when they are loaded, block returns nullptr if a block is corrupt.
+	write_file reads the mesh as a che (a mapped che_bin is paged from the file) but its work arrays
+	are O(n_vertices + n_faces) indexes in memory, it is used by ./convert_mesh --stream.
+*/
+class che_stream
+{
+	public:
+		struct header_t
+		{
+			char magic[8];					///< "GPSTREAM"
+			uint32_t version;
+			uint32_t size_index;			///< sizeof(index_t) used to write the files
+			uint64_t n_vertices;
+			uint64_t n_faces;
+			uint64_t n_blocks;
+		};
+
+		struct block_t
+		{
+			che * mesh;						///< local mesh: owned vertices and their stars
+			index_t * map;					///< local v -> global v
+			size_t n_owned;					///< owned vertices in [0, n_owned)
+			bool loaded;					///< the map is read completely and n_owned is a local vertex count
+
+			block_t(const std::string & file);
+			block_t(const block_t &) = delete;
+			~block_t();
+		};
+
+		static const uint32_t version = 1;
+
+	private:
+		std::string path;
+		size_t n_vertices_;
+		size_t n_faces_;
+		size_t n_blocks_;
+
+		index_t * owner;					///< v -> block
+		index_t * local;					///< v -> local v in its owner block
+		std::vector<size_t> n_owned;		///< b -> number of vertices owned by b
+
+		size_t cache_size;
+		std::list<index_t> lru;									///< cached blocks, the most recent first
+		std::vector<std::shared_ptr<block_t> > cache;			///< b -> block, empty if it is not cached
+		std::vector<std::list<index_t>::iterator> lru_pos;		///< b -> position in lru
+
+	public:
+		che_stream(const std::string & path_, const size_t & cache_size_ = 16);
+		che_stream(const che_stream &) = delete;
+		~che_stream();
+
+		std::shared_ptr<block_t> block(const index_t & b);
+		const index_t & owner_v(const index_t & v) const;
+		const index_t & local_v(const index_t & v) const;
+		const size_t & n_vertices() const;
+		const size_t & n_faces() const;
+		const size_t & n_blocks() const;
+
+		real_t mean_edge();
+		area_t area_surface();
+		void normals(vertex * n);					///< n[v]	: n_vertices, as che::normal
+		void laplacian(sp_mat_e & L, sp_mat_e & A);	///< as laplacian(che *, sp_mat_e &, sp_mat_e &)
+		void compute_toplesets(index_t * toplesets, index_t * sorted, std::vector<index_t> & limits, const std::vector<index_t> & sources);
+		void sort_by_block(index_t * first, index_t * last) const;
+
+	private:
+		bool valid_block(const block_t & blk, const index_t & b) const;
+
+	public:
+		static bool write_file(const che * mesh, const std::string & path, const size_t & block_size = 1 << 16);
+		static bool read_header(header_t & header, const std::string & path);
+};
+
+
+} // namespace gproshan
+
+#endif // CHE_STREAM_H
+
@@ -0,0 +1,57 @@
+#ifndef CHE_VIEW_H
+#define CHE_VIEW_H
+
+#include "che.h"
+
+
+// geometry processing and shape analysis framework
+namespace gproshan {
+
+
+/*!
+	Sub-mesh view of a che mesh, it does not copy the geometry nor the topology of the mesh.
+	The view is a subset of vertices renumbered in the given order (local vertices) and the faces of
+	the mesh with all their vertices in the subset. The half edges are the ones of the mesh, vt and gt
+	map them to the local vertices and ot is NIL across the faces out of the view, so that the
+	for_star and for_border macros work on a view as on a che mesh.
+	The mesh -> local map is allocated once, set() only updates the previous and the new subsets,
+	its cost is proportional to the stars of the subset and not to the size of the mesh.
+*/
+class che_view
+{
+	private:
+		const che * mesh;
+		size_t n_mesh_vertices;	///< size of inv
+		size_t n_vertices_;
+		size_t n_capacity;
+
+		index_t * V;	///< view vertices	: v		-> mesh v
+		index_t * inv;	///< inverse map	: mesh v	-> v, NIL if it is not in the view
+		index_t * EVT;	///< extra vertex table	: v		-> mesh he, as che::evt in the faces of the view
+
+	public:
+		che_view(const che * mesh_);
+		che_view(const che * mesh_, const index_t * vertices, const size_t & n);
+		che_view(const che_view &) = delete;
+		~che_view();
+
+		void set(const index_t * vertices, const size_t & n);
+
+		bool is_face(const index_t & t) const;
+		bool is_border_v(const index_t & v) const;
+		index_t vt(const index_t & he) const;
+		index_t ot(const index_t & he) const;
+		const vertex & gt(const index_t & v) const;
+		const index_t & evt(const index_t & v) const;
+		const index_t & mesh_v(const index_t & v) const;	///< local v -> mesh v
+		const index_t & local_v(const index_t & v) const;	///< mesh v -> local v, NIL if it is not in the view
+		const size_t & n_vertices() const;
+		const che * parent() const;
+		bool is_view_of(const che * mesh_) const;	///< set() can be called for the mesh_ as it is now
+};
+
+
+} // namespace gproshan
+
+#endif // CHE_VIEW_H
+
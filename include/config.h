@@ -7,6 +7,9 @@
 // uncomment this line to compile gproshan with single precision (float)
 //#define SINGLE_P
 
+// uncomment this line to compile gproshan with 64 bits indexes (meshes with more than 2^32 half edges)
+//#define INDEX_64
+
 // print log messages
 #define LOG
 
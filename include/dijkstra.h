@@ -2,31 +2,82 @@
 #define DIJKSTRA_H
 
 #include "che.h"
+#include "heap.h"
+
+#include <vector>
+#include <iostream>
+#include <cmath>
+
+#include <omp.h>
 
 
 // geometry processing and shape analysis framework
 namespace gproshan {
 
 
+/*!
+	Graph distances over the edges of a mesh (one ring graph, euclidean edge lengths) with an indexed
+	heap Dijkstra. A query can have several sources and stop at a radius or when a target vertex is
+	reached, it computes the predecessors tree and the closest source of each reached vertex.
+	The buffers are reused by the next queries: a query resets only the vertices reached by the
+	previous one. The vertices not reached by a query (farther than the radius or the target) have
+	distance INFINITY or an upper bound of their distance.
+*/
 class dijkstra
 {
 	private:
-		distance_t * weights;
-		index_t * predecessors;
+		che * mesh;
+		distance_t * weights;			///< v -> distance to the closest source
+		index_t * predecessors;			///< v -> previous vertex in the shortest path, NIL for the sources
+		index_t * roots;				///< v -> index in sources of the closest source
+		bool * fixed;					///< v -> v was settled, its distance and predecessor are final
 		size_t n_vertices;
-		index_t source;
+		std::vector<index_t> touched;	///< vertices with a distance set by the last query
+		std::vector<index_t> settled;	///< vertices sorted by distance of the last query
+		indexed_heap<distance_t> Q;
 
 	public:
+		dijkstra(che * shape);
 		dijkstra(che * shape, index_t src);
+		dijkstra(const dijkstra &) = delete;
 		~dijkstra();
 		distance_t & operator()(index_t i);
 		index_t & operator[](index_t i);
+		const index_t & root(const index_t & v) const;
+		const std::vector<index_t> & sorted() const;
 		void print(std::ostream & os);
 
-	private:
-		void run(che * shape);
+		/// Runs a query, it returns the number of settled vertices.
+		size_t run(const std::vector<index_t> & sources, const distance_t & radius = INFINITY, const index_t & target = NIL);
+
+		/// Shortest path from its closest source to v, empty if v was not settled by the query (not
+		/// reached, or reached with an upper bound of its distance after a radius or target stop).
+		std::vector<index_t> path(const index_t & v) const;
+
+		/// Single source queries in parallel, a dijkstra by thread: f(i, d) is called with the
+		/// dijkstra d of the query from sources[i], by the thread that ran it.
+		template <class F>
+		static void batch(che * shape, const std::vector<index_t> & sources, const F & f, const distance_t & radius = INFINITY);
 };
 
+template <class F>
+void dijkstra::batch(che * shape, const std::vector<index_t> & sources, const F & f, const distance_t & radius)
+{
+	if(shape->n_vertices()) shape->ring(0);		// the rings are built in parallel, not by the first thread alone
+
+	#pragma omp parallel
+	{
+		dijkstra d(shape);
+
+		#pragma omp for schedule(dynamic)
+		for(index_t i = 0; i < sources.size(); i++)
+		{
+			d.run({sources[i]}, radius);
+			f(i, d);
+		}
+	}
+}
+
 
 } // namespace gproshan
 
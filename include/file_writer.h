@@ -0,0 +1,151 @@
+#ifndef FILE_WRITER_H
+#define FILE_WRITER_H
+
+#include "include.h"
+#include "vertex.h"
+
+#include <string>
+#include <fstream>
+#include <charconv>
+#include <type_traits>
+#include <algorithm>
+#include <vector>
+
+#include <omp.h>
+
+
+// geometry processing and shape analysis framework
+namespace gproshan {
+
+
+/*!
+	Output layer of the mesh writers (che_off, che_obj, che_ply, che_img): the records are formatted
+	in memory (std::to_chars for the text formats) and written to the file in large blocks, instead of
+	an operator << and a flush by value. Large sections are formatted in parallel chunks.
+*/
+
+/// Growable buffer of formatted output.
+class out_buffer
+{
+	protected:
+		std::string buffer;
+
+	public:
+		const char * data() const { return buffer.data(); }
+		size_t size() const { return buffer.size(); }
+		void clear() { buffer.clear(); }
+		void reserve(const size_t & n) { buffer.reserve(n); }
+
+		/// Raw bytes (binary formats).
+		void write(const void * p, const size_t & n) { buffer.append((const char *) p, n); }
+
+		out_buffer & operator << (const char & c) { buffer.push_back(c); return *this; }
+		out_buffer & operator << (const char * s) { buffer.append(s); return *this; }
+		out_buffer & operator << (const std::string & s) { buffer.append(s); return *this; }
+
+		/// Shortest representation that reads back the same value.
+		template <class T, std::enable_if_t<std::is_arithmetic_v<T>, bool> = true>
+		out_buffer & operator << (const T x)
+		{
+			char s[32];
+			buffer.append(s, std::to_chars(s, s + sizeof(s), x).ptr);
+			return *this;
+		}
+
+		/// "x y z", as operator << (ostream &, const vertex &).
+		out_buffer & operator << (const vertex & v)
+		{
+			return *this << v[0] << ' ' << v[1] << ' ' << v[2];
+		}
+};
+
+/// Output file with a user space buffer, it is written when it is full and on destruction.
+/// The writers return the status of the last flush, the destructor only reports an error.
+class file_writer : public out_buffer
+{
+	private:
+		std::string file;
+		std::ofstream os;
+		size_t capacity;
+
+	public:
+		file_writer(const std::string & file_, const size_t & capacity_ = 1 << 24);
+		file_writer(const file_writer &) = delete;
+		~file_writer();
+
+		bool good() const;
+		bool flush();			///< writes the buffer to the file, false if the file has an error
+		void commit();			///< flush if the buffer is full
+
+		/// Formats the records [0, n) with format(out_buffer &, i) and writes them in order, in
+		/// parallel chunks of chunk_size records if parallel.
+		template <class F>
+		void write_records(const size_t & n, const F & format, const bool & parallel = true, const size_t & chunk_size = 1 << 15);
+};
+
+template <class F>
+void file_writer::write_records(const size_t & n, const F & format, const bool & parallel, const size_t & chunk_size)
+{
+	if(!parallel || n <= chunk_size)
+	{
+		for(size_t i = 0; i < n; i++)
+		{
+			format(*this, i);
+			commit();
+		}
+		return;
+	}
+
+	flush();
+
+	const size_t n_chunks = (n + chunk_size - 1) / chunk_size;
+	std::vector<out_buffer> chunks(omp_get_max_threads());
+
+	// a batch of a chunk by thread is formatted in parallel and written sequentially
+	for(size_t b = 0; b < n_chunks; b += chunks.size())
+	{
+		const size_t n_batch = std::min(chunks.size(), n_chunks - b);
+
+		#pragma omp parallel for
+		for(index_t c = 0; c < n_batch; c++)
+		{
+			out_buffer & out = chunks[c];
+			out.clear();
+
+			const size_t end = std::min<size_t>(n, (b + c + 1) * chunk_size);
+			for(size_t i = (b + c) * chunk_size; i < end; i++)
+				format(out, i);
+		}
+
+		for(index_t c = 0; c < n_batch; c++)
+			os.write(chunks[c].data(), chunks[c].size());
+	}
+}
+
+
+/// Header of the binary sidecar files of per vertex fields (distances, colours, ...).
+struct field_header_t
+{
+	char magic[8];					///< "GPFIELD"
+	uint32_t version;
+	uint32_t size_real;				///< sizeof(real_t) used to write the file
+	uint64_t n_vertices;
+	uint64_t dim;					///< values by vertex: 1 scalar field, 3 colours
+};
+
+/// Writes n bytes to file durably (checkpoints): they are written to file.tmp, which is synced and renamed
+/// over file, and then the directory is synced. file is not modified if any step fails.
+bool write_file_durable(const std::string & file, const void * data, const size_t & n);
+
+/// Writes n_vertices * dim values, values[v * dim + i], to a binary sidecar file (with write_file_durable
+/// if durable), false if the file is not completely written.
+bool write_field(const std::string & file, const real_t * values, const size_t & n_vertices, const size_t & dim = 1, const bool & durable = false);
+
+/// Reads a file written by write_field, false if it is not valid.
+bool read_field(const std::string & file, std::vector<real_t> & values, size_t & dim);
+
+
+} // namespace gproshan
+
+#endif // FILE_WRITER_H
+
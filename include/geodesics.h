@@ -2,13 +2,55 @@
 #define GEODESICS_H
 
 #include "che.h"
+#include "geodesics_ptp.h"
 #include "include_arma.h"
 
+#include <cmath>
+
 
 // geometry processing and shape analysis framework
 namespace gproshan {
 
 
+/*!
+	Planar update of the Fast Marching: distance of the vertex x of a triangle (x, x0, x1) from the
+	distances t0, t1 of x0, x1, with the edges X0 = x0 - x, X1 = x1 - x. It is the kernel ptp_update
+	of the PTP with the coefficients of the triangle, without allocations.
+	d is NIL if the front crosses the edge (x0, x1), else 0 or 1, the vertex of the update.
+	v is the point of the edge (or the vertex d) where the front comes from, relative to x.
+	It returns INFINITY if the triangle is degenerate.
+*/
+inline distance_t fm_planar_update(index_t & d, const vertex & X0, const vertex & X1, const distance_t & t0, const distance_t & t1, vertex & v)
+{
+	d = NIL;
+
+	const distance_t b = (X0, X1);
+	if(!((X0, X0) * (X1, X1) - b * b > 0)) return INFINITY;
+
+	const ptp_coef_t q(X0, X1);
+	const distance_t p = ptp_update(d, q, t0, t1);
+
+	if(d != NIL)
+	{
+		v = d ? X1 : X0;
+		return p;
+	}
+
+	// intersection of the line x - s n with the edge x0 + l (x1 - x0), least squares as in the 3x2 system
+	const vertex n = -((q.q00 * (t0 - p) + q.q01 * (t1 - p)) * X0 + (q.q01 * (t0 - p) + q.q11 * (t1 - p)) * X1);
+	const vertex e = X1 - X0;
+
+	const distance_t nn = (n, n);
+	const distance_t ne = (n, e);
+	const distance_t ee = (e, e);
+	const distance_t den = nn * ee - ne * ne;
+	const distance_t l = den != 0 ? (ne * (n, X0) - nn * (e, X0)) / den : 0;
+
+	v = X0 + l * e;
+
+	return p;
+}
+
 /*!
 	Compute the geodesics distances on a mesh from a source or multi-source. This class implements
 	the Fast Marching algorithm without deal with obtuse triangles. Also, if the options PTP_CPU or
@@ -68,7 +110,7 @@ class geodesics
 #endif // GPROSHAN_CUDA
 
 		distance_t update(index_t & d, che * mesh, const index_t & he, vertex & vx);
-		distance_t planar_update(index_t & d, a_mat & X, index_t * x, vertex & vx);
+		distance_t planar_update(index_t & d, const vertex * X, const index_t * x, vertex & vx);
 };
 
 
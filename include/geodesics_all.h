@@ -0,0 +1,43 @@
+#ifndef GEODESICS_ALL_H
+#define GEODESICS_ALL_H
+
+#include "geodesics.h"
+
+#include <functional>
+
+
+// geometry processing and shape analysis framework
+namespace gproshan {
+
+
+/*!
+	Reductions of the geodesic distances from each source vertex to all the vertices of the mesh,
+	the distance vectors of the sources are not stored. The arrays are indexed by the source vertex
+	and allocated by the caller (n_vertices), a reduction is not computed if its array is nullptr.
+*/
+struct all_pairs_t
+{
+	distance_t * mean = nullptr;	///< s -> mean distance from s to all the vertices, INFINITY if some vertex is not reached
+	distance_t * max = nullptr;		///< s -> max distance from s (eccentricity)
+	size_t * histogram = nullptr;	///< n_bins counts of the finite distances of all the pairs, accumulated by each call
+	size_t n_bins = 0;
+	distance_t hist_max = 0;		///< histogram range [0, hist_max], the last bin counts the larger distances too.
+									///< 0: it is set to twice the eccentricity of the vertex 0, a bound of the diameter
+};
+
+/// Geodesic distances from the sources [begin, end) to all the vertices, the sources are computed in
+/// parallel with a workspace by thread and the precomputation of the mesh is shared:
+/// PTP_CPU	: a sequential PTP by source with the update coefficients of the triangles precomputed.
+/// HEAT_FLOW	: the Cholesky factorizations are computed once and the sources are solved by batches.
+/// The sources are processed by chunks of chunk sources (0: a single chunk), checkpoint(e) is called
+/// after each chunk, when the mean and max of the sources [begin, e) are done (the histogram is
+/// accumulated at the end).
+void all_pairs_geodesics(all_pairs_t & out, che * mesh, const geodesics::option_t & opt = geodesics::PTP_CPU,
+						const index_t & begin = 0, index_t end = NIL,
+						const std::function<void(const index_t &)> & checkpoint = nullptr, size_t chunk = 0);
+
+
+} // namespace gproshan
+
+#endif // GEODESICS_ALL_H
+
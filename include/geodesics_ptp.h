@@ -8,6 +8,8 @@
 
 #include "che.h"
 
+#include <cmath>
+
 #define PTP_TOL 1e-3
 
 
@@ -15,6 +17,9 @@
 namespace gproshan {
 
 
+class che_stream;
+class che_view;
+
 struct ptp_out_t
 {
 	distance_t * dist;
@@ -29,6 +34,66 @@ struct toplesets_t
 	const index_t *const & index;
 };
 
+/// Coefficients of the planar update of the vertex x of a triangle (x, x0, x1), they depend only on the mesh:
+/// Q = (X^T X)^-1 of the edges X0 = x0 - x, X1 = x1 - x and the lengths l0, l1 of the edges.
+struct ptp_coef_t
+{
+	distance_t q00, q01, q11;
+	distance_t l0, l1;
+
+	ptp_coef_t() = default;
+
+	ptp_coef_t(const vertex & X0, const vertex & X1)
+	{
+		const distance_t a = (X0, X0);
+		const distance_t b = (X0, X1);
+		const distance_t c = (X1, X1);
+		const distance_t det = a * c - b * b;
+
+		q00 = c / det;
+		q01 = -b / det;
+		q11 = a / det;
+		l0 = sqrt(a);
+		l1 = sqrt(c);
+	}
+};
+
+/// Planar update of the distance of x from the distances t0, t1 of x0, x1, the kernel of update_step.
+/// d is NIL if the front crosses the edge (x0, x1), else 0 or 1, the vertex of the update.
+/// The condition Q X^T n is Q (t - p 1), because the front direction is n = X Q (t - p 1).
+inline distance_t ptp_update(index_t & d, const ptp_coef_t & q, const distance_t & t0, const distance_t & t1)
+{
+	d = NIL;
+
+	const distance_t s = q.q00 + 2 * q.q01 + q.q11;
+	const distance_t delta = t0 * (q.q00 + q.q01) + t1 * (q.q01 + q.q11);
+	const distance_t dis = delta * delta - s * (t0 * t0 * q.q00 + 2 * t0 * t1 * q.q01 + t1 * t1 * q.q11 - 1);
+	const distance_t p = (delta + sqrt(dis)) / s;
+
+	const distance_t c0 = q.q00 * (t0 - p) + q.q01 * (t1 - p);
+	const distance_t c1 = q.q01 * (t0 - p) + q.q11 * (t1 - p);
+
+	if(t0 == INFINITY || t1 == INFINITY || dis < 0 || c0 >= 0 || c1 >= 0)
+	{
+		const distance_t dp0 = t0 + q.l0;
+		const distance_t dp1 = t1 + q.l1;
+
+		d = dp1 < dp0;
+		return d ? dp1 : dp0;
+	}
+
+	return p;
+}
+
+inline distance_t update_step(const ptp_coef_t & q, const distance_t & t0, const distance_t & t1)
+{
+	index_t d;
+	return ptp_update(d, q, t0, t1);
+}
+
+/// The coefficients of all the half-edges of the mesh, the update of vt(he) in its triangle.
+ptp_coef_t * ptp_coefficients(che * mesh);
+
 che * ptp_coalescence(index_t * & inv, che * mesh, const toplesets_t & toplesets);
 
 double parallel_toplesets_propagation_coalescence_gpu(const ptp_out_t & ptp_out, che * mesh, const std::vector<index_t> & sources, const toplesets_t & toplesets, const bool & set_inf = 1);
@@ -37,12 +102,19 @@ double parallel_toplesets_propagation_gpu(const ptp_out_t & ptp_out, che * mesh,
 
 void parallel_toplesets_propagation_coalescence_cpu(const ptp_out_t & ptp_out, che * mesh, const std::vector<index_t> & sources, const toplesets_t & toplesets);
 
-void parallel_toplesets_propagation_cpu(const ptp_out_t & ptp_out, che * mesh, const std::vector<index_t> & sources, const toplesets_t & toplesets);
+/// coef are the coefficients of ptp_coefficients, or nullptr to compute the updates from the geometry.
+/// pdist and error are buffers of n_vertices distances to reuse between calls, or nullptr.
+/// Called inside a parallel region (e.g. a source by thread) it runs sequentially.
+void parallel_toplesets_propagation_cpu(const ptp_out_t & ptp_out, che * mesh, const std::vector<index_t> & sources, const toplesets_t & toplesets, const ptp_coef_t * coef = nullptr, distance_t * pdist_buffer = nullptr, distance_t * error_buffer = nullptr);
+
+void parallel_toplesets_propagation_stream(const ptp_out_t & ptp_out, che_stream & mesh, const std::vector<index_t> & sources, const toplesets_t & toplesets);
 
 distance_t farthest_point_sampling_ptp_gpu(che * mesh, std::vector<index_t> & samples, double & time_fps, size_t n, distance_t radio = 0);
 
 distance_t update_step(che * mesh, const distance_t * dist, const index_t & he);
 
+distance_t update_step(const che_view * mesh, const distance_t * dist, const index_t & he);
+
 void normalize_ptp(distance_t * dist, const size_t & n);
 
 
@@ -0,0 +1,144 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+#include "include.h"
+
+#include <vector>
+
+
+// geometry processing and shape analysis framework
+namespace gproshan {
+
+
+/*!
+	Indexed 4-ary min heap of n items (vertices) with decrease key: the position of each item in the
+	heap is stored, so that each item is at most once in the heap and its key is updated in place.
+	The heap can be reused by several queries, clear costs the number of items left in the heap.
+*/
+template <class T>
+class indexed_heap
+{
+	private:
+		struct node_t
+		{
+			T key;
+			index_t v;
+		};
+
+		static const size_t D = 4;
+
+		std::vector<node_t> heap;
+		std::vector<index_t> pos;		///< v -> position in heap, NIL if v is not in the heap
+
+	public:
+		indexed_heap(const size_t & n = 0): pos(n, NIL) {}
+
+		void resize(const size_t & n)
+		{
+			clear();
+			pos.assign(n, NIL);
+		}
+
+		size_t size() const { return heap.size(); }
+		bool empty() const { return heap.empty(); }
+		bool contains(const index_t & v) const { return pos[v] != NIL; }
+		const index_t & top() const { return heap.front().v; }
+		const T & top_key() const { return heap.front().key; }
+		const T & key(const index_t & v) const { return heap[pos[v]].key; }
+
+		/// Inserts v or decreases its key, it returns false if v is in the heap with a lower or equal key.
+		bool update(const index_t & v, const T & key)
+		{
+			index_t i = pos[v];
+
+			if(i == NIL)
+			{
+				i = heap.size();
+				heap.push_back({key, v});
+			}
+			else if(key < heap[i].key)
+				heap[i].key = key;
+			else
+				return false;
+
+			sift_up(i);
+			return true;
+		}
+
+		index_t pop()
+		{
+			const index_t v = heap.front().v;
+			pos[v] = NIL;
+
+			const node_t last = heap.back();
+			heap.pop_back();
+
+			if(!heap.empty())
+			{
+				heap.front() = last;
+				sift_down(0);
+			}
+
+			return v;
+		}
+
+		void clear()
+		{
+			for(const node_t & node: heap)
+				pos[node.v] = NIL;
+
+			heap.clear();
+		}
+
+	private:
+		void sift_up(index_t i)
+		{
+			const node_t node = heap[i];
+
+			while(i)
+			{
+				const index_t p = (i - 1) / D;
+				if(!(node.key < heap[p].key)) break;
+
+				heap[i] = heap[p];
+				pos[heap[i].v] = i;
+				i = p;
+			}
+
+			heap[i] = node;
+			pos[node.v] = i;
+		}
+
+		void sift_down(index_t i)
+		{
+			const node_t node = heap[i];
+			const size_t n = heap.size();
+
+			while(true)
+			{
+				const size_t first = D * i + 1;
+				if(first >= n) break;
+
+				const size_t last = first + D < n ? first + D : n;
+
+				size_t c = first;
+				for(size_t j = first + 1; j < last; j++)
+					if(heap[j].key < heap[c].key) c = j;
+
+				if(!(heap[c].key < node.key)) break;
+
+				heap[i] = heap[c];
+				pos[heap[i].v] = i;
+				i = c;
+			}
+
+			heap[i] = node;
+			pos[node.v] = i;
+		}
+};
+
+
+} // namespace gproshan
+
+#endif // HEAP_H
+
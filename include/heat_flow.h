@@ -22,6 +22,25 @@ namespace gproshan {
 
 distance_t * heat_flow(che * mesh, const std::vector<index_t> & sources, double & solve_time);
 
+/// Heat method with the Cholesky factorizations of the mesh computed once, the solves of the next
+/// queries reuse them. A query of several sources is solved by columns, a column by source.
+class heat_flow_solver
+{
+	private:
+		che * mesh;
+		cholmod_common context;
+		cholmod_factor * heat;		///< factorization of A + dt L
+		cholmod_factor * poisson;	///< factorization of L
+
+	public:
+		heat_flow_solver(che * shape);
+		heat_flow_solver(const heat_flow_solver &) = delete;
+		~heat_flow_solver();
+
+		/// dist[i * n_vertices + v] is the distance from sources[i] to v, it returns the solve time.
+		double solve(distance_t * dist, const std::vector<index_t> & sources);
+};
+
 #ifdef GPROSHAN_CUDA
 distance_t * heat_flow_gpu(che * mesh, const std::vector<index_t> & sources, double & solve_time);
 #endif // GPROSHAN_CUDA
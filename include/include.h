@@ -9,14 +9,18 @@
 
 #include <omp.h>
 
-#define NIL (0u - 1)
-
 
 // geometry processing and shape analysis framework
 namespace gproshan {
 
 
-typedef unsigned int index_t;
+#ifdef INDEX_64
+	typedef unsigned long long index_t;
+#else
+	typedef unsigned int index_t;
+#endif
+
+#define NIL (~gproshan::index_t(0))
 
 #ifdef SINGLE_P
 	typedef float real_t;
@@ -11,7 +11,11 @@
 namespace gproshan {
 
 
-typedef Eigen::SparseMatrix<double> sp_mat_e;
+#ifdef INDEX_64
+	typedef Eigen::SparseMatrix<double, Eigen::ColMajor, long long> sp_mat_e;
+#else
+	typedef Eigen::SparseMatrix<double> sp_mat_e;
+#endif
 
 void laplacian(che * mesh, a_sp_mat & L, a_sp_mat & A);
 
@@ -4,12 +4,40 @@
 #include "geodesics.h"
 #include "geodesics_ptp.h"
 
+#include <string>
+#include <vector>
+#include <cstdint>
+
 
 // geometry processing and shape analysis framework
 namespace gproshan {
 
 void save_dists(const char * outfile, distance_t * mean_dists, size_t num_dists);
 
+/// Header of the checkpoints of run_geodesics, <outputfile>.<begin>-<end>.part, followed by the mean
+/// distances of all the vertices (NAN for the vertices not computed).
+struct checkpoint_header_t
+{
+	char magic[8];				///< "GPGEOCK"
+	uint32_t version;
+	uint32_t size_real;			///< sizeof(distance_t) used to write the file
+	uint32_t method;
+	uint32_t padding;
+	uint64_t begin;				///< source vertices range of the run
+	uint64_t end;
+	uint64_t n_vertices;
+	uint64_t mesh_hash;			///< che_bin::hash of the mesh
+};
+
+/// Writes the checkpoint durably (write_file_durable), false if the previous one was kept.
+bool save_checkpoint(const std::string & partfile, const checkpoint_header_t & header, const distance_t * mean_dists);
+
+/// Reads a checkpoint, false if it is not valid.
+bool read_checkpoint(const std::string & partfile, checkpoint_header_t & header, std::vector<distance_t> & mean_dists);
+
+/// Assembles the checkpoints of the shards of run_geodesics in the text output.
+void merge_dists(const int & nargs, const char ** args);
+
 void run_geodesics(const int & nargs, const char ** args);
 
 /// Execute performance and accuracy test for ptp algorithm on cpu and gpu.
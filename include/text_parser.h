@@ -0,0 +1,98 @@
+#ifndef TEXT_PARSER_H
+#define TEXT_PARSER_H
+
+#include "include.h"
+
+#include <vector>
+#include <charconv>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+
+
+// geometry processing and shape analysis framework
+namespace gproshan {
+
+
+/*!
+	Helpers of the parallel parsers of text mesh files (che_off, che_obj): the file is memory mapped,
+	split in chunks at new line boundaries and the values are parsed with std::from_chars, without
+	allocations by line.
+*/
+
+/// Blanks of a line (not the new line).
+inline const char * skip_blanks(const char * p, const char * end)
+{
+	while(p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+	return p;
+}
+
+/// Begin of the next line, end if p is in the last line.
+inline const char * next_line(const char * p, const char * end)
+{
+	p = (const char *) memchr(p, '\n', end - p);
+	return p ? p + 1 : end;
+}
+
+/// A line with data: not empty nor a comment.
+inline bool is_data_line(const char * p, const char * end)
+{
+	p = skip_blanks(p, end);
+	return p < end && *p != '\n' && *p != '#';
+}
+
+/// White spaces, new lines and comments.
+inline const char * skip_spaces(const char * p, const char * end)
+{
+	while(p < end)
+	{
+		if(*p == '#') p = next_line(p, end);
+		else if(isspace(*p)) p++;
+		else break;
+	}
+	return p;
+}
+
+/// Parses the next value of the line after p, x is not modified if there is not a value.
+template <class T>
+inline const char * parse(const char * p, const char * end, T & x)
+{
+	p = skip_blanks(p, end);
+	if(p < end && *p == '+') p++;
+
+	return std::from_chars(p, end, x).ptr;
+}
+
+/// Parses the next value of the line after p and moves p after it, false if there is not a valid value.
+template <class T>
+inline bool parse_next(const char *& p, const char * end, T & x)
+{
+	p = skip_blanks(p, end);
+	if(p < end && *p == '+') p++;
+
+	const std::from_chars_result r = std::from_chars(p, end, x);
+	p = r.ptr;
+
+	return r.ec == std::errc();
+}
+
+/// Splits [begin, end) in n chunks (some of them can be empty) at new line boundaries, the chunk c is
+/// [chunks[c], chunks[c + 1]).
+inline std::vector<const char *> text_chunks(const char * begin, const char * end, size_t n)
+{
+	n = std::max(std::min(n, size_t(end - begin)), size_t(1));
+
+	std::vector<const char *> chunks(n + 1);
+	chunks[0] = begin;
+	chunks[n] = end;
+	for(index_t c = 1; c < n; c++)
+		chunks[c] = next_line(std::max(begin + (end - begin) * c / n, chunks[c - 1] + 1) - 1, end);
+
+	return chunks;
+}
+
+
+} // namespace gproshan
+
+#endif // TEXT_PARSER_H
+
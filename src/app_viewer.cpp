@@ -9,36 +9,23 @@ double load_time;
 distance_t * dist;
 size_t n_dist;
 
-che * load_mesh(const string & file_path)
-{
-	size_t pos = file_path.rfind('.');
-	assert(pos != string::npos);
-	
-	string extension = file_path.substr(pos + 1);
-
-	if(extension == "off") return new che_off(file_path);
-	if(extension == "obj") return new che_obj(file_path);
-	if(extension == "ply") return new che_ply(file_path);
-
-	return new che_img(file_path);
-}
-
 int viewer_main(int nargs, const char ** args)
 {
 	if(nargs < 2)
 	{
-		printf("./gproshan [mesh_paths.(off,obj,ply)]\n");
+		printf("./gproshan [mesh_paths.(off,obj,ply,che,gpz,png,jpg)]\n");
 		return 0;
 	}
 
 	TIC(load_time)
 
-	vector<che *> meshes;
-	for(int i = 1; i < nargs; i++)
-		meshes.push_back(load_mesh(args[i]));
+	vector<che *> meshes = load_meshes(vector<string>(args + 1, args + nargs));
+	meshes.erase(remove(meshes.begin(), meshes.end(), nullptr), meshes.end());
 
 	TOC(load_time)
 
+	if(meshes.empty()) return 0;
+
 	gproshan_log_var(sizeof(real_t));
 	gproshan_log_var(load_time);
 
@@ -186,14 +173,22 @@ void viewer_process_noise()
 
 	srand(time(nullptr));
 
+	che * mesh = viewer::mesh();
+
+	// the normals are read from the cache, the new positions are set after the loop
+	vertex * positions = new vertex[mesh->n_vertices()];
+
 	#pragma omp parallel for
-	for(index_t v = 0; v < viewer::mesh()->n_vertices(); v++)
+	for(index_t v = 0; v < mesh->n_vertices(); v++)
 	{
 		distance_t r = distance_t( rand() % 1000 ) / 200000;
 		int p = rand() % 5;
-		viewer::mesh()->get_vertex(v) += (!p) * r * viewer::mesh()->normal(v);
+		positions[v] = mesh->gt(v) + (!p) * r * mesh->normal(v);
 	}
 
+	mesh->set_vertices(positions);
+	delete [] positions;
+
 	viewer::mesh().update_normals();
 }
 
@@ -203,15 +198,23 @@ void viewer_process_black_noise()
 
 	srand(time(nullptr));
 
+	che * mesh = viewer::mesh();
+
+	// the normals are read from the cache, the new positions are set after the loop
+	vertex * positions = new vertex[mesh->n_vertices()];
+
 	#pragma omp parallel for
-	for(index_t v = 0; v < viewer::mesh()->n_vertices(); v++)
+	for(index_t v = 0; v < mesh->n_vertices(); v++)
 	{
 		distance_t r = distance_t( rand() % 1000 ) / 200000;
 		int p = rand() % 5;
-		viewer::mesh()->get_vertex(v) += (!p) * r * viewer::mesh()->normal(v);
+		positions[v] = mesh->gt(v) + (!p) * r * mesh->normal(v);
 		if(!p) viewer::vcolor(v) = INFINITY;
 	}
 
+	mesh->set_vertices(positions);
+	delete [] positions;
+
 	viewer::mesh().update_normals();
 }
 
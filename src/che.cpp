@@ -1,4 +1,5 @@
 #include "che.h"
+#include "che_soa.h"
 
 #include "include_arma.h"
 #include "viewer/viewer.h"
@@ -7,6 +8,11 @@
 #include <cmath>
 #include <cassert>
 #include <set>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+#include <sys/mman.h>
 
 using namespace std;
 
@@ -15,6 +21,52 @@ using namespace std;
 namespace gproshan {
 
 
+static const size_t arena_align = 64;			// cache line
+static const size_t huge_page = 2 << 20;		// transparent huge pages (2 MB)
+static const size_t page = 4096;
+
+// Places the tables GT, VT, OT, EVT, EHT, ET, BT of sizes[i] bytes in the arena: tables[i] (nullptr if it is
+// empty). The arena is reused if its capacity is enough and not more than twice the required size.
+// ET and BT are reserved at the end with their maximum sizes, their unused pages are never touched, so that
+// they do not use physical memory. The other pages are touched in parallel (first touch NUMA placement).
+static void arena_tables(char *& arena, size_t & arena_size, void ** tables, const size_t * sizes)
+{
+	size_t offset[7], size = 0;
+	for(index_t i = 0; i < 7; i++)
+	{
+		offset[i] = size;
+		size += (sizes[i] + arena_align - 1) / arena_align * arena_align;
+	}
+
+	if(arena && (size > arena_size || 2 * size < arena_size))
+	{
+		free(arena);
+		arena = nullptr;
+		arena_size = 0;
+	}
+
+	if(size && !arena)
+	{
+		const size_t align = size < huge_page ? arena_align : huge_page;
+		arena_size = (size + align - 1) / align * align;
+		arena = (char *) aligned_alloc(align, arena_size);
+		assert(arena);
+
+	#ifdef MADV_HUGEPAGE
+		if(align == huge_page) madvise(arena, arena_size, MADV_HUGEPAGE);
+	#endif
+	}
+
+	const size_t touched = offset[5];
+
+	#pragma omp parallel for
+	for(size_t i = 0; i < touched; i += page)
+		memset(arena + i, 0, min(page, touched - i));
+
+	for(index_t i = 0; i < 7; i++)
+		tables[i] = sizes[i] ? arena + offset[i] : nullptr;
+}
+
 index_t trig(const index_t & he)
 {
 	if(he == NIL) return NIL;
@@ -45,6 +97,7 @@ CHE::CHE(che * mesh)
 	EVT = mesh->EVT;
 }
 
+// the copy shares the tables with mesh, they are copied by the first edit of any of them (copy on write)
 che::che(const che & mesh)
 {
 	filename_		= mesh.filename_;
@@ -54,26 +107,25 @@ che::che(const che & mesh)
 	n_edges_		= mesh.n_edges_;
 	n_borders_		= mesh.n_borders_;
 
-	GT = new vertex[n_vertices_];
-	memcpy(GT, mesh.GT, n_vertices_ * sizeof(vertex));
-
-	VT = new index_t[n_half_edges_];
-	memcpy(VT, mesh.VT, n_half_edges_ * sizeof(index_t));
-
-	OT = new index_t[n_half_edges_];
-	memcpy(OT, mesh.OT, n_half_edges_ * sizeof(index_t));
-
-	EVT = new index_t[n_vertices_];
-	memcpy(EVT, mesh.EVT, n_vertices_ * sizeof(index_t));
+	mesh.share();
 
-	ET = new index_t[n_edges_];
-	memcpy(ET, mesh.ET, n_edges_ * sizeof(index_t));
+	GT	= mesh.GT;
+	VT	= mesh.VT;
+	OT	= mesh.OT;
+	EVT	= mesh.EVT;
+	ET	= mesh.ET;
+	EHT	= mesh.EHT;
+	BT	= mesh.BT;
 
-	EHT = new index_t[n_half_edges_];
-	memcpy(EHT, mesh.EHT, n_half_edges_ * sizeof(index_t));
+	shared_gt = mesh.shared_gt;
+	shared_vt = mesh.shared_vt;
+	shared_ot = mesh.shared_ot;
 
-	BT = new index_t[n_borders_];
-	memcpy(BT, mesh.BT, n_borders_ * sizeof(index_t));
+	manifold = mesh.manifold;
+	RO = RV = RL = RS = nullptr;
+	FA = VA = nullptr;
+	FN = VN = nullptr;
+	dirty = true;
 }
 
 che::che(const size_t & n_v, const size_t & n_f)
@@ -81,11 +133,36 @@ che::che(const size_t & n_v, const size_t & n_f)
 	init(n_v, n_f);
 }
 
-che::che(const vertex * vertices, const index_t & n_v, const index_t * faces, const index_t & n_f)
+che::che(const vertex * vertices, const size_t & n_v, const index_t * faces, const size_t & n_f)
 {
 	init(vertices, n_v, faces, n_f);
 }
 
+// borrow: GT and VT point to vertices and faces, they must outlive the mesh and its copies, the mesh never
+// modifies them (copy on write); only the topology tables OT, EVT, ET, EHT and BT are computed
+che::che(const vertex * vertices, const size_t & n_v, const index_t * faces, const size_t & n_f, const bool & borrow)
+{
+	if(!borrow)
+	{
+		init(vertices, n_v, faces, n_f);
+		return;
+	}
+
+	// owners without deleter: the tables are borrowed
+	shared_gt = shared_ptr<void>((void *) vertices, [](void *) {});
+	shared_vt = shared_ptr<void>((void *) faces, [](void *) {});
+
+	init(n_v, n_f);		// it does not allocate the borrowed tables
+	if(n_vertices_ != n_v) return;
+
+	GT = (vertex *) vertices;
+	VT = (index_t *) faces;
+
+	update_evt_ot_et();
+	update_eht();
+	update_bt();
+}
+
 che::~che()
 {
 	delete_me();
@@ -111,6 +188,33 @@ void che::link(link_t & l, const index_t & v)
 	}
 }
 
+ring_t che::star(const index_t & v)
+{
+	assert(v < n_vertices_);
+	const index_t * ro = rings_offsets();
+
+	index_t end = ro[v + 1];
+	if(end > ro[v] && RS[end - 1] == NIL) end--;
+
+	return {RS + ro[v], RS + end};
+}
+
+ring_t che::link(const index_t & v)
+{
+	assert(v < n_vertices_);
+	const index_t * ro = rings_offsets();
+
+	return {RL + ro[v], RL + ro[v + 1]};
+}
+
+ring_t che::ring(const index_t & v)
+{
+	assert(v < n_vertices_);
+	const index_t * ro = rings_offsets();
+
+	return {RV + ro[v], RV + ro[v + 1]};
+}
+
 void che::border(vector<index_t> & border, const index_t & b)
 {
 	for_border(he, this, BT[b])
@@ -136,6 +240,9 @@ void che::flip(const index_t & e)
 	if(hb == NIL)
 		return;
 
+	detach_vt();
+	detach_ot();
+
 	index_t va = VT[ha];
 	index_t vb = VT[hb];
 	index_t vc = VT[prev(ha)];
@@ -182,6 +289,9 @@ void che::flip(const index_t & e)
 	if(EVT[vb] == next(ha) || EVT[vb] == hb) EVT[vb] = prev(ha);
 	if(EVT[vc] == prev(ha)) EVT[vc] = next(hb);
 	if(EVT[vd] == prev(hb)) EVT[vd] = next(ha);
+
+	delete_rings();
+	dirty = true;
 }
 
 // https://www.mathworks.com/help/pde/ug/pdetriq.html
@@ -201,11 +311,16 @@ real_t che::pdetriq(const index_t & t) const
 
 real_t che::quality()
 {
+	real_t * pq = new real_t[n_faces_];
+	che_soa(this).pdetriqs(pq);
+
 	real_t q = 0;
 
 	#pragma omp parallel for reduction(+: q)
 	for(index_t t = 0; t < n_faces_; t++)
-		q += pdetriq(t) > 0.6; // is confederating good triangle
+		q += pq[t] > 0.6; // is confederating good triangle
+
+	delete [] pq;
 
 	return q * 100 / n_faces_;
 }
@@ -221,11 +336,10 @@ area_t che::area_trig(const index_t & t) const
 
 area_t che::area_vertex(const index_t & v)
 {
-	area_t area_star = 0;
-	for_star(he, this, v)
-		area_star += area_trig(trig(he));
+	assert(v < n_vertices_);
+	if(dirty) update_attributes();
 
-	return area_star / 3;
+	return VA[v];
 }
 
 area_t che::area_surface() const
@@ -247,18 +361,18 @@ vertex che::normal_he(const index_t & he) const
 
 vertex che::normal(const index_t & v)
 {
-	vertex n;
-	area_t area, area_star = 0;
+	assert(v < n_vertices_);
+	if(dirty) update_attributes();
 
-	for_star(he, this, v)
-	{
-		area = area_trig(trig(he));
-		area_star += area;
-		n += area * normal_he(he);
-	}
+	return VN[v];
+}
 
-	n /= area_star;
-	return n / *n;
+const vertex & che::normal_trig(const index_t & t)
+{
+	assert(t < n_faces_);
+	if(dirty) update_attributes();
+
+	return FN[t];
 }
 
 vertex che::gradient_he(const index_t & he, const distance_t *const & f) const
@@ -333,19 +447,27 @@ real_t che::cotan(const index_t & he) const
 
 real_t che::mean_edge() const
 {
-	real_t m = 0;
-
-	#pragma omp parallel for reduction(+: m)
-	for(index_t e = 0; e < n_edges_; e++)
-		m += *(GT[VT[ET[e]]] - GT[VT[next(ET[e])]]);
-
-	return m / n_edges_;
+	return che_soa(this).mean_edge();
 }
 
+// the tables in the arena are counted with their alignment padding, the reserved pages of ET and BT that
+// are not used are not counted (they are never touched)
 size_t che::memory() const
 {
-	return sizeof(*this) + n_vertices_ * (sizeof(vertex) + sizeof(index_t)) + filename_.size()
-						+ sizeof(index_t) * (3 * n_half_edges_ + n_edges_ + n_borders_);
+	auto bytes = [this](const void * table, const size_t & n) -> size_t
+	{
+		return in_arena(table) ? (n + arena_align - 1) / arena_align * arena_align : n;
+	};
+
+	return sizeof(*this) + filename_.size()
+						+ bytes(GT, n_vertices_ * sizeof(vertex))
+						+ bytes(VT, n_half_edges_ * sizeof(index_t))
+						+ bytes(OT, n_half_edges_ * sizeof(index_t))
+						+ bytes(EVT, n_vertices_ * sizeof(index_t))
+						+ bytes(EHT, n_half_edges_ * sizeof(index_t))
+						+ sizeof(index_t) * (n_edges_ + n_borders_)
+						+ (RO ? sizeof(index_t) * (n_vertices_ + 1 + 3 * RO.load()[n_vertices_]) : 0)
+						+ (FA ? (sizeof(area_t) + sizeof(vertex)) * (n_faces_ + n_vertices_) : 0);
 }
 
 size_t che::genus() const
@@ -356,6 +478,8 @@ size_t che::genus() const
 
 void che::normalize()
 {
+	detach_gt();
+
 	vertex center;
 
 	#pragma omp parallel for
@@ -379,6 +503,8 @@ void che::normalize()
 	#pragma omp parallel for
 	for(index_t v = 0; v < n_vertices_; v++)
 		GT[v] /= max_norm;
+
+	dirty = true;
 }
 
 bool che::is_manifold() const
@@ -498,8 +624,23 @@ size_t che::max_degree() const
 	return md;
 }
 
+/// Prepares GT to be edited with get_vertex: it is copied if it is shared and the attributes caches
+/// are invalidated. It is called once before the parallel edit loops, so that get_vertex does not
+/// copy GT in a thread.
+void che::edit_vertices()
+{
+	detach_gt();
+	dirty = true;
+}
+
+/// A shared or borrowed GT (copies of the mesh, caller buffers, mapped che files) is copied by the
+/// first get_vertex, the shared_gt check does not touch the reference counter. dirty is only stored
+/// if it is not set, the parallel edit loops do not write the same cache line in each call.
 vertex & che::get_vertex(index_t v)
 {
+	if(shared_gt) detach_gt();
+	if(!dirty.load(memory_order_relaxed)) dirty.store(true, memory_order_relaxed);
+
 	return GT[v];
 }
 
@@ -507,7 +648,11 @@ void che::set_vertices(const vertex *const& positions, size_t n, const index_t &
 {
 	if(!positions) return;
 	if(!n) n = n_vertices_;
+
+	detach_gt();
 	memcpy(GT + v_i, positions, sizeof(vertex) * n);
+
+	dirty = true;
 }
 
 const string & che::filename() const
@@ -539,57 +684,177 @@ const string che::name_size() const
 
 void che::reload()
 {
-	delete_me();
+	delete_tables();
 	init(filename_);
 }
 
+toplesets_ws_t::~toplesets_ws_t()
+{
+	resize(0);
+}
+
+void toplesets_ws_t::resize(const size_t & n)
+{
+	if(n && n <= n_vertices) return;
+
+	delete [] toplesets;
+	delete [] sorted;
+	delete [] visited;
+	delete [] frontier;
+
+	toplesets = sorted = nullptr;
+	visited = frontier = nullptr;
+	n_vertices = n;
+
+	if(!n) return;
+
+	toplesets = new index_t[n];
+	sorted = new index_t[n];
+	visited = new uint64_t[(n + 63) >> 6];
+	frontier = new uint64_t[(n + 63) >> 6];
+}
+
 void che::compute_toplesets(index_t *& toplesets, index_t *& sorted, vector<index_t> & limits, const vector<index_t> & sources, const index_t & k)
 {
 	if(!sources.size()) return;
 
-	memset(toplesets, -1, sizeof(index_t) * n_vertices_);
+	toplesets_ws_t ws;
+	compute_toplesets(ws, sources, k);
 
-	index_t level = 0;
+	memcpy(toplesets, ws.toplesets, sizeof(index_t) * n_vertices_);
+	memcpy(sorted, ws.sorted, sizeof(index_t) * ws.limits.back());
+	limits.insert(limits.end(), ws.limits.begin(), ws.limits.end());
+}
+
+/// Level synchronous parallel BFS, each level is expanded top-down from the frontier or bottom-up
+/// from the unvisited vertices when the frontier is large (direction optimizing BFS, Beamer et al.).
+/// The levels are the same of a serial BFS, the order of the vertices inside a level may change.
+void che::compute_toplesets(toplesets_ws_t & ws, const vector<index_t> & sources, const index_t & k)
+{
+	ws.limits.clear();
+	if(!sources.size()) return;
+
+	ws.resize(n_vertices_);
+
+	index_t * toplesets = ws.toplesets;
+	index_t * sorted = ws.sorted;
+	uint64_t * visited = ws.visited;
+	uint64_t * frontier = ws.frontier;
+	const size_t n_words = (n_vertices_ + 63) >> 6;
+
+	memset(toplesets, -1, sizeof(index_t) * n_vertices_);
+	memset(visited, 0, sizeof(uint64_t) * n_words);
 
 	index_t p = 0;
 	for(const index_t & s: sources)
 	{
 		sorted[p++] = s;
-		
+
 		if(toplesets[s] == NIL)
-			toplesets[s] = level;
+		{
+			toplesets[s] = 0;
+			visited[s >> 6] |= uint64_t(1) << (s & 63);
+		}
 	}
 
-	limits.push_back(0);
-	for(index_t i = 0; i < p; i++)
+	rings_offsets();
+
+	index_t level = 0;
+	index_t begin = 0, end = p;
+
+	ws.limits.push_back(0);
+	while(begin < end)
 	{
-		const index_t & v = sorted[i];
-		
-		if(toplesets[v] > level)
-		{
-			level++;
+		// bottom-up needs symmetric rings, non manifold vertices have no star (EVT NIL)
+		const bool bottom_up = manifold && end - begin > (n_vertices_ - p) / 14;
 
-			if(level > k) break;
+		if(bottom_up)
+		{
+			memset(frontier, 0, sizeof(uint64_t) * n_words);
 
-			limits.push_back(i);
+			#pragma omp parallel for
+			for(index_t i = begin; i < end; i++)
+			{
+				const index_t & v = sorted[i];
+				#pragma omp atomic
+				frontier[v >> 6] |= uint64_t(1) << (v & 63);
+			}
 		}
 
-		link_t v_link;
-		link(v_link, v);
-		for(const index_t & he: v_link)
+		#pragma omp parallel if(end - begin > 256 || bottom_up)
 		{
-			const index_t & u = VT[he];
+			// vertices of the next level are buffered by thread, then copied to sorted
+			index_t next_level[256];
+			index_t n = 0;
+
+			auto flush = [&]()
+			{
+				index_t i;
+				#pragma omp atomic capture
+				{ i = p; p += n; }
+
+				memcpy(sorted + i, next_level, sizeof(index_t) * n);
+				n = 0;
+			};
+
+			auto add = [&](const index_t & u)
+			{
+				toplesets[u] = level + 1;
+				next_level[n++] = u;
+				if(n == 256) flush();
+			};
 
-			if(toplesets[u] == NIL)
+			if(bottom_up)
 			{
-				toplesets[u] = toplesets[v] + 1;
-				sorted[p++] = u;
+				#pragma omp for schedule(static, 1024)
+				for(index_t u = 0; u < n_vertices_; u++)
+				{
+					if(toplesets[u] != NIL) continue;
+
+					for(const index_t & v: ring(u))
+						if(frontier[v >> 6] & (uint64_t(1) << (v & 63)))
+						{
+							#pragma omp atomic
+							visited[u >> 6] |= uint64_t(1) << (u & 63);
+
+							add(u);
+							break;
+						}
+				}
+			}
+			else
+			{
+				#pragma omp for schedule(dynamic, 64)
+				for(index_t i = begin; i < end; i++)
+				for(const index_t & u: ring(sorted[i]))
+				{
+					const uint64_t bit = uint64_t(1) << (u & 63);
+					uint64_t word;
+
+					#pragma omp atomic read
+					word = visited[u >> 6];
+					if(word & bit) continue;
+
+					#pragma omp atomic capture
+					{ word = visited[u >> 6]; visited[u >> 6] |= bit; }
+					if(!(word & bit)) add(u);
+				}
 			}
+
+			flush();
 		}
+
+		if(level == k) break;		// the last topleset includes the vertices of the level k + 1
+
+		level++;
+		begin = end;
+		end = p;
+
+		if(begin < end) ws.limits.push_back(begin);
 	}
-	
+
 	assert(p <= n_vertices_);
-	limits.push_back(p);
+	ws.limits.push_back(p);
 }
 
 void che::multiplicate_vertices()
@@ -735,129 +1000,343 @@ void che::multiplicate_vertices()
 
 void che::remove_non_manifold_vertices()
 {
-	for( index_t he = 0; he < n_half_edges_; he+=3)
+	edit_t edit;
+	for(index_t v = 0; v < n_vertices_; v++)
+		if(EVT[v] == NIL) edit.removed_vertices.push_back(v);
+
+	commit(edit);
+}
+
+void che::remove_vertices(const vector<index_t> & vertices)
+{
+	if(!vertices.size()) return;
+
+	edit_t edit;
+	edit.removed_vertices = vertices;
+
+	commit(edit);
+}
+
+// map[i] = number of flagged elements before i, or NIL if i is not flagged; returns the number of flagged elements.
+// Exclusive prefix sum computed by blocks in parallel.
+template<class F>
+static size_t compact_map(index_t * map, const size_t & n, const F & flag)
+{
+	vector<size_t> count(omp_get_max_threads() + 1, 0);
+	size_t n_threads = 1;
+
+	#pragma omp parallel
 	{
-		if(EVT[ VT[he] ] == NIL || EVT[ VT[he+1]] == NIL || EVT[ VT[he+2] ] == NIL)
+		const size_t nt = omp_get_num_threads();
+		const size_t t = omp_get_thread_num();
+		const size_t begin = n * t / nt;
+		const size_t end = n * (t + 1) / nt;
+
+		size_t c = 0;
+		for(size_t i = begin; i < end; i++)
+			c += flag(i);
+
+		count[t + 1] = c;
+
+		#pragma omp barrier
+		#pragma omp single
 		{
-			VT[he] = NIL;
-			VT[he + 1 ] = NIL;
-			VT[he + 2 ] = NIL;
+			n_threads = nt;
+			for(size_t i = 0; i < nt; i++)
+				count[i + 1] += count[i];
 		}
+
+		c = count[t];
+		for(size_t i = begin; i < end; i++)
+			map[i] = flag(i) ? c++ : NIL;
 	}
 
-	/* save in vectors */
-	vector<vertex> new_vertices;
-	vector<index_t> removed;
-	vector<index_t> new_faces; // each 3
+	return count[n_threads];
+}
 
-	gproshan_debug(removing vertex);
-	for(index_t v = 0; v < n_vertices_; v++)
+void che::commit(edit_t & edit)
+{
+	const size_t n_new_v = edit.new_vertices.size();
+	const size_t n_new_f = edit.new_faces.size() / P;
+	const size_t n_v = n_vertices_ + n_new_v;			// old and new vertices
+
+	// removed[v]: v is removed, affected[v]: the star of v changes
+	char * removed = new char[n_v];
+	char * affected = new char[n_v];
+	char * keep = new char[n_faces_];
+
+	memset(removed, 0, n_v);
+	memset(affected, 0, n_vertices_);
+	memset(affected + n_vertices_, 1, n_new_v);
+	memset(keep, 1, n_faces_);
+
+	for(const index_t & v: edit.removed_vertices)
+		removed[v] = 1;
+
+	for(const index_t & t: edit.removed_faces)
+		keep[t] = 0;
+
+	for(const index_t & v: edit.new_faces)
 	{
-		if(EVT[v] != NIL)
-			new_vertices.push_back(GT[v]);
-		else
-			removed.push_back(v);
+		assert(v < n_v && !removed[v]);
+		affected[v] = 1;
 	}
-	removed.push_back(n_vertices_);
 
-	gproshan_debug_var(removed.size());
-	gproshan_debug_var(removed[0]);
-	index_t r = 1;
-	index_t d = 1;
-	for(index_t v = removed[0] + 1; v < n_vertices_; v++)
+	#pragma omp parallel for
+	for(index_t t = 0; t < n_faces_; t++)
 	{
-		if(v < removed[r])
-		{
-			for_star(he, this, v)
-				if(VT[he] != NIL) VT[he] = v - d;
-		}
-		else if(v == removed[r])
+		const index_t * f = VT + t * P;
+
+		if(keep[t] && (removed[f[0]] || removed[f[1]] || removed[f[2]]))
+			keep[t] = 0;
+
+		if(!keep[t])
+		for(index_t i = 0; i < P; i++)
 		{
-			d++;
-			r++;
+			#pragma omp atomic write
+			affected[f[i]] = 1;
 		}
 	}
 
-	for(index_t he = 0; he < n_half_edges_; he++)
-		if(VT[he] != NIL)
-			new_faces.push_back(VT[he]);
-		else gproshan_error_var(he);
+	// compaction maps
+	edit.vertex_map.resize(n_v);
+	edit.face_map.resize(n_faces_);
+
+	const index_t * v_map = edit.vertex_map.data();
+	const index_t * f_map = edit.face_map.data();
+
+	const size_t nv = compact_map(edit.vertex_map.data(), n_v, [&](const size_t & v) { return !removed[v]; });
+	const size_t n_kept = compact_map(edit.face_map.data(), n_faces_, [&](const size_t & t) { return keep[t]; });
+	const size_t nf = n_kept + n_new_f;
+	const size_t nh = P * nf;
+
+	// the new tables are stored in a new arena, it replaces the current one
+	char * n_arena = nullptr;
+	size_t n_arena_size = 0;
+
+	void * tables[7];
+	const size_t sizes[7] = {	nv * sizeof(vertex),
+								nh * sizeof(index_t),
+								nh * sizeof(index_t),
+								nv * sizeof(index_t),
+								nh * sizeof(index_t),
+								nh * sizeof(index_t),
+								nv * sizeof(index_t)
+								};
+	arena_tables(n_arena, n_arena_size, tables, sizes);
+
+	vertex * nGT	= (vertex *) tables[0];
+	index_t * nVT	= (index_t *) tables[1];
+	index_t * nOT	= (index_t *) tables[2];
+	index_t * nEVT	= (index_t *) tables[3];
+	index_t * nEHT	= (index_t *) tables[4];
+	index_t * nET	= (index_t *) tables[5];
 
-	gproshan_debug_var(new_vertices.size());
-	gproshan_debug_var(new_faces.size());
-	gproshan_debug(removing vertex);
-	delete_me();
-	gproshan_debug(removing vertex);
-	init(new_vertices.data(), new_vertices.size(), new_faces.data(), new_faces.size() / P);
-	gproshan_debug(removing vertex);
-}
+	#pragma omp parallel for
+	for(index_t v = 0; v < n_v; v++)
+		if(v_map[v] != NIL)
+			nGT[v_map[v]] = v < n_vertices_ ? GT[v] : edit.new_vertices[v - n_vertices_];
 
-void che::remove_vertices(const vector<index_t> & vertices)
-{
-	if(!vertices.size()) return;
+	#pragma omp parallel for
+	for(index_t he = 0; he < n_half_edges_; he++)
+		if(keep[trig(he)])
+			nVT[f_map[trig(he)] * P + he % P] = v_map[VT[he]];
+
+	#pragma omp parallel for
+	for(index_t i = 0; i < P * n_new_f; i++)
+		nVT[P * n_kept + i] = v_map[edit.new_faces[i]];
 
-	gproshan_debug(removing vertex);
-	for(index_t v: vertices)
+	// the topology of a non manifold mesh is rebuilt
+	if(!manifold)
 	{
-		for_star(he, this, v)
-		{
-			VT[he] = NIL;
-			VT[prev(he)] = NIL;
-			VT[next(he)] = NIL;
+		delete [] removed;
+		delete [] affected;
+		delete [] keep;
 
-			gproshan_debug_var(he);
-			gproshan_debug_var(next(he));
-			gproshan_debug_var(prev(he));
-		}
+		delete_tables();
+		init(nGT, nv, nVT, nf);
 
-		gproshan_debug_var(EVT[v]);
-		EVT[v] = NIL;
+		free(n_arena);
+		return;
 	}
-	/* save in vectors */
-	vector<vertex> new_vertices;
-	vector<index_t> removed;
-	vector<index_t> new_faces; // each 3
 
-	gproshan_debug(removing vertex);
+	auto map_he = [&](const index_t & he) -> index_t
+	{
+		return he == NIL || !keep[trig(he)] ? NIL : f_map[trig(he)] * P + he % P;
+	};
+
+	#pragma omp parallel for
+	for(index_t he = 0; he < n_half_edges_; he++)
+		if(keep[trig(he)])
+			nOT[f_map[trig(he)] * P + he % P] = map_he(OT[he]);
+
+	memset(nOT + P * n_kept, -1, sizeof(index_t) * P * n_new_f);
+
+	#pragma omp parallel for
 	for(index_t v = 0; v < n_vertices_; v++)
+		if(v_map[v] != NIL && !affected[v])
+			nEVT[v_map[v]] = map_he(EVT[v]);
+
+	// affected faces: the new faces and the kept faces incident to an affected vertex
+	index_t * a_map = new index_t[n_faces_];
+	const size_t n_affected = compact_map(a_map, n_faces_, [&](const size_t & t)
+							{
+								const index_t * f = VT + t * P;
+								return keep[t] && (affected[f[0]] || affected[f[1]] || affected[f[2]]);
+							});
+
+	vector<index_t> faces(n_affected + n_new_f);
+
+	#pragma omp parallel for
+	for(index_t t = 0; t < n_faces_; t++)
+		if(a_map[t] != NIL) faces[a_map[t]] = f_map[t];
+
+	for(index_t t = 0; t < n_new_f; t++)
+		faces[n_affected + t] = n_kept + t;
+
+	delete [] a_map;
+
+	// the pairs broken by faces edited in place (e.g. edge_collapse moves the faces of vb to va) are opened
+	#pragma omp parallel for
+	for(index_t i = 0; i < faces.size(); i++)
+	for(index_t he = faces[i] * P; he < faces[i] * P + P; he++)
 	{
-		if(EVT[v] != NIL)
-			new_vertices.push_back(GT[v]);
-		else
-			removed.push_back(v);
+		const index_t & o = nOT[he];
+		if(o != NIL && !(nVT[o] == nVT[next(he)] && nVT[next(o)] == nVT[he]))
+			nOT[he] = NIL;
 	}
-	removed.push_back(n_vertices_);
 
-	gproshan_debug_var(removed.size());
-	gproshan_debug_var(removed[0]);
-	index_t r = 1;
-	index_t d = 1;
-	for(index_t v = removed[0] + 1; v < n_vertices_; v++)
+	// open half edges of the affected faces sorted by edge key (min(v), max(v))
+	vector<pair<pair<index_t, index_t>, index_t> > open_he;
+	for(const index_t & t: faces)
+	for(index_t he = t * P; he < t * P + P; he++)
+		if(nOT[he] == NIL)
+		{
+			const index_t & a = nVT[he];
+			const index_t & b = nVT[next(he)];
+			open_he.push_back({{min(a, b), max(a, b)}, he});
+		}
+
+	sort(open_he.begin(), open_he.end());
+
+	vector<index_t> groups;
+	for(index_t i = 0; i < open_he.size(); i++)
+		if(!i || open_he[i].first != open_he[i - 1].first)
+			groups.push_back(i);
+	groups.push_back(open_he.size());
+
+	// each he is paired with the free opposite he with the lowest next, as update_evt_ot_et
+	#pragma omp parallel for
+	for(index_t g = 0; g < groups.size() - 1; g++)
+	for(index_t k = groups[g]; k < groups[g + 1]; k++)
 	{
-		if(v < removed[r])
+		const index_t & he = open_he[k].second;
+		if(nOT[he] != NIL) continue;
+
+		index_t ohe = NIL;
+		for(index_t o = groups[g]; o < groups[g + 1]; o++)
 		{
-			for_star(he, this, v)
-				if(VT[he] != NIL) VT[he] = v - d;
+			const index_t & h = open_he[o].second;
+			if(nOT[h] == NIL && nVT[h] == nVT[next(he)] && nVT[next(h)] == nVT[he])
+				if(ohe == NIL || next(h) < next(ohe)) ohe = h;
 		}
-		else if(v == removed[r])
+
+		if(ohe != NIL)
 		{
-			d++;
-			r++;
+			nOT[he] = ohe;
+			nOT[ohe] = he;
 		}
 	}
 
-	for(index_t he = 0; he < n_half_edges_; he++)
-		if(VT[he] != NIL)
-			new_faces.push_back(VT[he]);
-		else gproshan_error_var(he);
+	// extra vertex table of the affected vertices: last he, its border he, or NIL if it has more than one border he
+	char * n_affected_v = new char[nv];
+
+	#pragma omp parallel for
+	for(index_t v = 0; v < n_v; v++)
+		if(v_map[v] != NIL)
+		{
+			n_affected_v[v_map[v]] = affected[v];
+			if(affected[v]) nEVT[v_map[v]] = NIL;
+		}
+
+	vector<pair<index_t, index_t> > v_he;		// (new v, he)
+	for(const index_t & t: faces)
+	for(index_t he = t * P; he < t * P + P; he++)
+		if(n_affected_v[nVT[he]])
+			v_he.push_back({nVT[he], he});
+
+	delete [] n_affected_v;
+
+	sort(v_he.begin(), v_he.end());
+
+	bool non_manifold = false;
+	for(index_t i = 0, j; i < v_he.size(); i = j)
+	{
+		const index_t & v = v_he[i].first;
+
+		index_t n_border = 0;
+		for(j = i; j < v_he.size() && v_he[j].first == v; j++)
+		{
+			const index_t & he = v_he[j].second;
+			if(nOT[he] == NIL)
+			{
+				nEVT[v] = he;
+				n_border++;
+			}
+			else if(!n_border) nEVT[v] = he;
+		}
+
+		if(n_border > 1)
+		{
+			non_manifold = true;
+			nEVT[v] = NIL;
+		}
+	}
+
+	delete [] removed;
+	delete [] affected;
+	delete [] keep;
+
+	// edge table: the he with no opposite or the lowest of the pair
+	index_t * e_map = nh ? new index_t[nh] : nullptr;
+	const size_t ne = compact_map(e_map, nh, [&](const size_t & he) { return nOT[he] == NIL || he < nOT[he]; });
+
+	#pragma omp parallel for
+	for(index_t he = 0; he < nh; he++)
+		if(e_map[he] != NIL)
+		{
+			nET[e_map[he]] = he;
+			nEHT[he] = e_map[he];
+			if(nOT[he] != NIL) nEHT[nOT[he]] = e_map[he];
+		}
+
+	delete [] e_map;
 
-	gproshan_debug_var(new_vertices.size());
-	gproshan_debug_var(new_faces.size());
-	gproshan_debug(removing vertex);
 	delete_me();
-	gproshan_debug(removing vertex);
-	init(new_vertices.data(), new_vertices.size(), new_faces.data(), new_faces.size() / P);
-	gproshan_debug(removing vertex);
+
+	arena = n_arena;
+	arena_size = n_arena_size;
+
+	n_vertices_ = nv;
+	n_faces_ = nf;
+	n_half_edges_ = nh;
+	n_edges_ = ne;
+	n_borders_ = 0;
+
+	GT = nGT;
+	VT = nVT;
+	OT = nOT;
+	EVT = nEVT;
+	ET = nET;
+	EHT = nEHT;
+	BT = (index_t *) tables[6];
+	RO = RV = RL = RS = nullptr;
+	FA = VA = nullptr;
+	FN = VN = nullptr;
+	dirty = true;
+	manifold = !non_manifold;
+
+	update_bt();
 }
 
 void che::merge(const che * mesh, const vector<index_t> & com_vertices)
@@ -968,6 +1447,10 @@ gproshan_debug(fill_holes);
 
 void che::set_head_vertices(index_t * head, const size_t & n)
 {
+	detach_gt();
+	detach_vt();
+	detach_ot();
+
 	for(index_t v, i = 0; i < n; i++)
 	{
 		v = head[i];
@@ -993,28 +1476,196 @@ void che::set_head_vertices(index_t * head, const size_t & n)
 			else if(BT[b] == v) BT[b] = i;
 		}
 	}
+
+	delete_rings();
+	dirty = true;
 }
 
-index_t che::link_intersect(const index_t & v_a, const index_t & v_b)
+/// Reorder vertices and faces to improve the memory locality of the che tables.
+/// Faces are sorted by their minimum vertex in the new order, keeping their orientation.
+/// Return a new array sorted: new vertex -> old vertex, to map back per vertex results.
+index_t * che::reorder(const reorder_t & opt)
 {
-	index_t intersect = 0;
+	index_t * sorted = new index_t[n_vertices_];
 
-	link_t link_a, link_b;
-	link(link_a, v_a);
-	link(link_b, v_b);
+	#pragma omp parallel for
+	for(index_t v = 0; v < n_vertices_; v++)
+		sorted[v] = v;
 
-	for(index_t & he_a: link_a)
-	for(index_t & he_b: link_b)
-		if(VT[he_a] == VT[he_b])
-			intersect++;
+	if(!n_vertices_) return sorted;
 
-	return intersect;
-}
+	if(opt == MORTON)
+	{
+		vertex pmin = GT[0], pmax = GT[0];
+		for(index_t v = 1; v < n_vertices_; v++)
+		for(index_t i = 0; i < 3; i++)
+		{
+			pmin[i] = min(pmin[i], GT[v][i]);
+			pmax[i] = max(pmax[i], GT[v][i]);
+		}
 
+		// 21 bits per coordinate interleaved in a 63 bits code
+		auto spread = [](uint64_t x) -> uint64_t
+		{
+			x &= 0x1fffff;
+			x = (x | x << 32) & 0x1f00000000ffff;
+			x = (x | x << 16) & 0x1f0000ff0000ff;
+			x = (x | x << 8) & 0x100f00f00f00f00f;
+			x = (x | x << 4) & 0x10c30c30c30c30c3;
+			x = (x | x << 2) & 0x1249249249249249;
+			return x;
+		};
+
+		uint64_t * code = new uint64_t[n_vertices_];
+
+		#pragma omp parallel for
+		for(index_t v = 0; v < n_vertices_; v++)
+		{
+			code[v] = 0;
+			for(index_t i = 0; i < 3; i++)
+			{
+				real_t d = pmax[i] > pmin[i] ? (GT[v][i] - pmin[i]) / (pmax[i] - pmin[i]) : 0;
+				code[v] |= spread(d * 0x1fffff) << i;
+			}
+		}
+
+		sort(sorted, sorted + n_vertices_, [&code](const index_t & a, const index_t & b) { return code[a] < code[b]; });
+
+		delete [] code;
+	}
+
+	if(opt == RCM)
+	{
+		// Cuthill-McKee: BFS from a minimum degree vertex of each component, visiting neighbors by increasing degree
+		index_t * degree = new index_t[n_vertices_];
+		bool * visited = new bool[n_vertices_];
+
+		#pragma omp parallel for
+		for(index_t v = 0; v < n_vertices_; v++)
+		{
+			degree[v] = 0;
+			for_star(he, this, v) degree[v]++;
+			if(EVT[v] != NIL) degree[v] += is_border_v(v);
+			visited[v] = false;
+		}
+
+		index_t * by_degree = new index_t[n_vertices_];
+		memcpy(by_degree, sorted, sizeof(index_t) * n_vertices_);
+		stable_sort(by_degree, by_degree + n_vertices_, [&degree](const index_t & a, const index_t & b) { return degree[a] < degree[b]; });
+
+		index_t p = 0;
+		for(index_t s = 0; s < n_vertices_; s++)
+		{
+			if(visited[by_degree[s]]) continue;
+
+			visited[by_degree[s]] = true;
+			sorted[p++] = by_degree[s];
+
+			for(index_t i = p - 1; i < p; i++)
+			{
+				index_t n = p;
+
+				for(const index_t & u: ring(sorted[i]))
+					if(!visited[u])
+					{
+						visited[u] = true;
+						sorted[p++] = u;
+					}
+
+				sort(sorted + n, sorted + p, [&degree](const index_t & a, const index_t & b) { return degree[a] < degree[b]; });
+			}
+		}
+
+		reverse(sorted, sorted + n_vertices_);
+
+		delete [] degree;
+		delete [] visited;
+		delete [] by_degree;
+	}
+
+	index_t * inv = new index_t[n_vertices_];
+
+	#pragma omp parallel for
+	for(index_t v = 0; v < n_vertices_; v++)
+		inv[sorted[v]] = v;
+
+	vector<vertex> vertices(n_vertices_);
+
+	#pragma omp parallel for
+	for(index_t v = 0; v < n_vertices_; v++)
+		vertices[v] = GT[sorted[v]];
+
+	// faces by their minimum new vertex, keeping the orientation
+	vector<index_t> faces_order(n_faces_);
+	vector<index_t> faces_key(n_faces_);
+
+	#pragma omp parallel for
+	for(index_t t = 0; t < n_faces_; t++)
+	{
+		faces_order[t] = t;
+		faces_key[t] = NIL;
+		for(index_t i = 0; i < P; i++)
+			faces_key[t] = min(faces_key[t], inv[VT[t * P + i]]);
+	}
+
+	stable_sort(faces_order.begin(), faces_order.end(), [&faces_key](const index_t & a, const index_t & b) { return faces_key[a] < faces_key[b]; });
+
+	vector<index_t> faces(n_half_edges_);
+
+	#pragma omp parallel for
+	for(index_t t = 0; t < n_faces_; t++)
+	for(index_t i = 0; i < P; i++)
+		faces[t * P + i] = inv[VT[faces_order[t] * P + i]];
+
+	delete [] inv;
+
+	delete_tables();
+	init(vertices.data(), vertices.size(), faces.data(), faces.size() / P);
+
+	return sorted;
+}
+
+index_t che::link_intersect(const index_t & v_a, const index_t & v_b)
+{
+	index_t intersect = 0;
+
+	// it does not use the precomputed rings, edge_collapse updates VT while it is calling it
+	for_star(he_a, this, v_a)
+	for(index_t a = 0; a < 2; a++)
+	{
+		if(a && OT[prev(he_a)] != NIL) continue;
+		const index_t & u = a ? VT[prev(he_a)] : VT[next(he_a)];
+
+		for_star(he_b, this, v_b)
+		{
+			if(VT[next(he_b)] == u) intersect++;
+			if(OT[prev(he_b)] == NIL && VT[prev(he_b)] == u) intersect++;
+		}
+	}
+
+	return intersect;
+}
+
+// owner = min(owner, r), atomically
+static inline void atomic_min(index_t & owner, const index_t & r)
+{
+	index_t o = __atomic_load_n(&owner, __ATOMIC_RELAXED);
+	while(r < o && !__atomic_compare_exchange_n(&owner, &o, r, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+// The edges are collapsed in the order given by sort_edges (random if it is null), an edge is collapsed if
+// the faces of the stars of its vertices were not modified by a previous collapse. The collapses are applied
+// in rounds: in each round the candidate edges that are first in the order among the candidates sharing a face
+// with them are independent and they are collapsed in parallel, the result is the same as the serial order.
 corr_t * che::edge_collapse(const index_t *const & sort_edges, const vertex *const & normals)
 {
 	if(n_faces_ < 2) return nullptr;
 
+	detach_gt();
+	detach_vt();
+	detach_ot();
+	dirty = true;	// GT and VT are edited in place
+
 	// init default corr
 	corr_t * corr = new corr_t[n_vertices_];
 	#pragma omp parallel for
@@ -1026,66 +1677,127 @@ corr_t * che::edge_collapse(const index_t *const & sort_edges, const vertex *con
 	index_t * deleted_vertices = new index_t[n_vertices_];
 	memset(deleted_vertices, 0, sizeof(index_t) * n_vertices_);
 
-	index_t e_d, he_d, ohe_d, va, vb;
-	vertex aux_va, aux_vb;
+	// edges in the collapse order, each edge is considered once
+	vector<index_t> order;
+	order.reserve(n_edges_);
+
+	bool * in_order = new bool[n_edges_];
+	memset(in_order, 0, sizeof(bool) * n_edges_);
 
-	// update corr to vertex opposite to edge
+	for(index_t e = 0; e < n_edges_; e++)
+	{
+		const index_t & e_d = sort_edges ? sort_edges[e] : rand() % n_edges_;
+		assert(e_d < n_edges_);
+
+		if(!in_order[e_d])
+		{
+			in_order[e_d] = true;
+			order.push_back(e_d);
+		}
+	}
+
+	delete [] in_order;
+
+	// candidates: the collapse keeps the mesh manifold, it does not depend on the previous collapses if
+	// the stars of va and vb are not fixed
+	index_t * pos = new index_t[order.size()];
+	const size_t n_candidates = compact_map(pos, order.size(), [&](const size_t & i)
+							{
+								const index_t & he_d = ET[order[i]];
+								const index_t & va = VT[he_d];
+								const index_t & vb = VT[next(he_d)];
+
+								//is_border_v(va) && is_border_v(vb) -> is_border_e(e_d)
+								return (!(is_border_v(va) && is_border_v(vb)) || is_border_e(order[i])) &&
+										link_intersect(va, vb) == (1 + (OT[he_d] != NIL));
+							});
+
+	// (rank in the order, edge)
+	vector<pair<index_t, index_t> > alive(n_candidates), next_alive;
+
+	#pragma omp parallel for
+	for(index_t i = 0; i < order.size(); i++)
+		if(pos[i] != NIL) alive[pos[i]] = {i, order[i]};
+
+	delete [] pos;
+
+	// first candidate edge in the order containing each face in the stars of its vertices
+	index_t * owner = new index_t[n_faces_];
+	memset(owner, -1, sizeof(index_t) * n_faces_);
+
+	bool * selected = new bool[n_candidates];
+
+	// update corr to vertex opposite to edge, the vertex can be opposite to edges collapsed in the same round,
+	// only the collapse of the face of its EVT updates it
 	auto update_corr_v = [this, &corr](const index_t & he)
 	{
 		index_t v = VT[prev(he)];
-		if(trig(EVT[v]) == trig(he))
+
+		index_t evt;
+		#pragma omp atomic read
+		evt = EVT[v];
+
+		if(trig(evt) == trig(he))
 		{
+			#pragma omp atomic write
 			EVT[v] = OT[next(he)];
-			corr[v].init(EVT[v]);
+
+			corr[v].init(OT[next(he)]);
 		}
 	};
 
-	bool is_collapse;
-
-	for(index_t e = 0; e < n_edges_; e++)
+	while(alive.size())
 	{
-		//e_d = ne;
-		e_d = sort_edges ? sort_edges[e] : rand() % n_edges_;
-		assert(e_d < n_edges_);
+		#pragma omp parallel for
+		for(index_t i = 0; i < alive.size(); i++)
+		{
+			const index_t & r = alive[i].first;
+			const index_t & he_d = ET[alive[i].second];
 
-		he_d = ET[e_d];
-		ohe_d = OT[he_d];
-		va = VT[he_d];
-		vb = VT[next(he_d)];
+			for_star(he, this, VT[he_d])
+				atomic_min(owner[trig(he)], r);
+			for_star(he, this, VT[next(he_d)])
+				atomic_min(owner[trig(he)], r);
+		}
 
-		//is_border_v(va) && is_border_v(vb) -> is_border_e(e_d)
-		if( !faces_fixed[trig(he_d)] && (ohe_d != NIL ? !faces_fixed[trig(ohe_d)] : true) &&
-			(!(is_border_v(va) && is_border_v(vb)) || is_border_e(e_d)) )
+		#pragma omp parallel for
+		for(index_t i = 0; i < alive.size(); i++)
 		{
-			is_collapse = link_intersect(va, vb) == (1 + (ohe_d != NIL));
+			const index_t & r = alive[i].first;
+			const index_t & he_d = ET[alive[i].second];
 
-			if(is_collapse)
-			for_star(he, this, va)
-				if(faces_fixed[trig(he)])
-				{
-					is_collapse = false;
-					break;
-				}
+			bool & sel = selected[i] = true;
 
-			if(is_collapse)
-			for_star(he, this, vb)
-				if(faces_fixed[trig(he)])
-				{
-					is_collapse = false;
-					break;
-				}
+			for_star(he, this, VT[he_d])
+				sel = sel && owner[trig(he)] == r;
+			for_star(he, this, VT[next(he_d)])
+				sel = sel && owner[trig(he)] == r;
+		}
+
+		// collapse the independent edges
+		#pragma omp parallel
+		{
+			vector<index_t> he_trigs;
 
-			if(is_collapse)
+			#pragma omp for schedule(dynamic)
+			for(index_t i = 0; i < alive.size(); i++)
 			{
+				if(!selected[i]) continue;
+
+				const index_t & he_d = ET[alive[i].second];
+				const index_t & ohe_d = OT[he_d];
+				const index_t va = VT[he_d];
+				const index_t vb = VT[next(he_d)];
+
 				update_corr_v(he_d);
 				if(ohe_d != NIL)
 					update_corr_v(ohe_d);
 
 				for_star(he, this, va)
-					if(!faces_fixed[trig(he)]) faces_fixed[trig(he)] = 1;
+					faces_fixed[trig(he)] = 1;
 
 				for_star(he, this, vb)
-					if(!faces_fixed[trig(he)]) faces_fixed[trig(he)] = 1;
+					faces_fixed[trig(he)] = 1;
 
 				faces_fixed[trig(he_d)] = -1;
 				if(ohe_d != NIL) faces_fixed[trig(ohe_d)] = -1;
@@ -1094,11 +1806,11 @@ corr_t * che::edge_collapse(const index_t *const & sort_edges, const vertex *con
 
 				deleted_vertices[vb] = 1;
 
-				aux_va = GT[va];
-				aux_vb = GT[vb];
+				const vertex aux_va = GT[va];
+				const vertex aux_vb = GT[vb];
 				GT[va] = GT[vb] = (GT[va] + GT[vb]) / 2;
 
-				vector<index_t> he_trigs;
+				he_trigs.clear();
 				for_star(he, this, va)
 				if(faces_fixed[trig(he)] > -1)
 					he_trigs.push_back(trig(he) * P);
@@ -1106,51 +1818,73 @@ corr_t * che::edge_collapse(const index_t *const & sort_edges, const vertex *con
 				if(faces_fixed[trig(he)] > -1)
 					he_trigs.push_back(trig(he) * P);
 
-				gproshan_debug_var(va);
 				corr[va] = find_corr(aux_va, normals[va], he_trigs);
-				gproshan_debug_var(vb);
 				corr[vb] = find_corr(aux_vb, normals[vb], he_trigs);
 
 				EVT[vb] = NIL;
 			}
 		}
-	}
 
-	vector<vertex> new_vertices;
-	vector<index_t> new_faces;
-	new_vertices.reserve(n_vertices_);
-	new_faces.reserve(n_faces_);
+		// the candidates touching a fixed face are discarded
+		next_alive.clear();
 
-	index_t dv = 0;
-	for(index_t v = 0; v < n_vertices_; v++)
-	{
-		if(deleted_vertices[v]) dv++;
-		else
+		#pragma omp parallel
 		{
-			deleted_vertices[v] = dv;
-			new_vertices.push_back(GT[v]);
+			vector<pair<index_t, index_t> > next_alive_t;
+
+			#pragma omp for nowait
+			for(index_t i = 0; i < alive.size(); i++)
+			{
+				if(selected[i]) continue;
+
+				const index_t & he_d = ET[alive[i].second];
+				bool fixed = false;
+
+				for_star(he, this, VT[he_d])
+				{
+					fixed = fixed || faces_fixed[trig(he)];
+
+					#pragma omp atomic write
+					owner[trig(he)] = NIL;
+				}
+				for_star(he, this, VT[next(he_d)])
+				{
+					fixed = fixed || faces_fixed[trig(he)];
+
+					#pragma omp atomic write
+					owner[trig(he)] = NIL;
+				}
+
+				if(!fixed) next_alive_t.push_back(alive[i]);
+			}
+
+			#pragma omp critical
+			next_alive.insert(next_alive.end(), next_alive_t.begin(), next_alive_t.end());
 		}
+
+		sort(next_alive.begin(), next_alive.end());
+		swap(alive, next_alive);
 	}
 
-	index_t * map_he = new index_t[n_half_edges_];
-	memset(map_he, 255, sizeof(index_t) * n_half_edges_);
+	delete [] owner;
+	delete [] selected;
 
-	for(index_t n_he = 0, he = 0; he < n_half_edges_; he++)
-		if(faces_fixed[trig(he)] > -1)
-		{
-			new_faces.push_back(VT[he] - deleted_vertices[VT[he]]);
-			map_he[he] = n_he++;
-		}
+	// the collapsed faces and vertices are removed, the faces of vb were already moved to va
+	edit_t edit;
 
 	for(index_t v = 0; v < n_vertices_; v++)
-		corr[v].t = trig(map_he[corr[v].t * P]);
+		if(deleted_vertices[v]) edit.removed_vertices.push_back(v);
 
-	delete_me();
-	init(new_vertices.data(), new_vertices.size(), new_faces.data(), new_faces.size() / P);
+	for(index_t t = 0; t < n_faces_; t++)
+		if(faces_fixed[t] == -1) edit.removed_faces.push_back(t);
+
+	commit(edit);
+
+	for(index_t v = 0; v < edit.vertex_map.size(); v++)
+		if(corr[v].t != NIL) corr[v].t = edit.face_map[corr[v].t];
 
 	delete [] faces_fixed;
 	delete [] deleted_vertices;
-	delete [] map_he;
 
 	return corr;
 }
@@ -1251,7 +1985,7 @@ corr_t che::find_corr(const vertex & v, const vertex & n, const vector<index_t>
 	return corr_d;
 }
 
-void che::init(const vertex * vertices, const index_t & n_v, const index_t * faces, const index_t & n_f)
+void che::init(const vertex * vertices, const size_t & n_v, const index_t * faces, const size_t & n_f)
 {
 	init(n_v, n_f);
 
@@ -1267,6 +2001,9 @@ void che::init(const string & file)
 {
 	filename_ = file;
 	read_file(filename_);
+
+	if(n_edges_) return;	// topology tables already loaded by read_file (e.g. che_bin)
+
 	update_evt_ot_et();
 	update_eht();
 	update_bt();
@@ -1278,18 +2015,32 @@ void che::init(const size_t & n_v, const size_t & n_f)
 	n_faces_ = n_f;
 	n_half_edges_ = n_edges_ = n_borders_ = 0;
 
+	// NIL is reserved, all the indexes (vertices and half edges) must be less than it
+	if(n_vertices_ >= NIL || che::P * n_faces_ >= NIL)
+	{
+	#ifdef INDEX_64
+		gproshan_error(the mesh exceeds the 64 bits indexes);
+	#else
+		gproshan_error(the mesh requires 64 bits indexes: define INDEX_64 in config.h);
+	#endif
+		gproshan_error_var(n_vertices_);
+		gproshan_error_var(n_faces_);
+
+		n_vertices_ = n_faces_ = 0;
+	}
+
 	GT = nullptr;
-	VT = OT = EVT = ET = BT = nullptr;
+	VT = OT = EVT = ET = EHT = BT = nullptr;
+	RO = RV = RL = RS = nullptr;
+	FA = VA = nullptr;
+	FN = VN = nullptr;
+	dirty = true;
 	manifold = true;
 
 	n_half_edges_ = che::P * n_faces_;
 	n_edges_ = 0; //n_half_edges_ / 2;	/**/
 	
-	if(n_vertices_)		GT = new vertex[n_vertices_];
-	if(n_half_edges_)	VT = new index_t[n_half_edges_];
-	if(n_half_edges_)	OT = new index_t[n_half_edges_];
-	if(n_vertices_)		EVT = new index_t[n_vertices_];
-	if(n_vertices_)		EHT = new index_t[n_half_edges_];
+	alloc_tables();
 }
 
 void che::update_evt_ot_et()
@@ -1298,67 +2049,140 @@ void che::update_evt_ot_et()
 	
 	if(!n_faces_) return;
 
-	vector<index_t> * he_p_vertex = new vector<index_t>[n_vertices_];
+	// half-edges by vertex (CSR)	: he_v[he_v_off[v] .. he_v_off[v + 1]) -> he, with VT[he] == v
+	index_t * he_v_off = new index_t[n_vertices_ + 1];
+	index_t * he_v_pos = new index_t[n_vertices_];
+	index_t * he_v = new index_t[n_half_edges_];
+
+	memset(he_v_off, 0, sizeof(index_t) * (n_vertices_ + 1));
+
+	#pragma omp parallel for
+	for(index_t he = 0; he < n_half_edges_; he++)
+	{
+		#pragma omp atomic
+		he_v_off[VT[he] + 1]++;
+	}
+
+	for(index_t v = 0; v < n_vertices_; v++)
+		he_v_off[v + 1] += he_v_off[v];
+
+	memcpy(he_v_pos, he_v_off, sizeof(index_t) * n_vertices_);
 
-	//vertex table
+	#pragma omp parallel for
 	for(index_t he = 0; he < n_half_edges_; he++)
 	{
-		EVT[VT[he]] = he;
-		he_p_vertex[VT[he]].push_back(he);
+		index_t p;
+		#pragma omp atomic capture
+		p = he_v_pos[VT[he]]++;
+
+		he_v[p] = he;
 	}
 
+	#pragma omp parallel for schedule(dynamic, 1024)
+	for(index_t v = 0; v < n_vertices_; v++)
+		sort(he_v + he_v_off[v], he_v + he_v_off[v + 1]);
+
 	//opposite table - edge table
 	memset(OT, -1, sizeof(index_t) * n_half_edges_);
 
-	vector<index_t> et;
-	for(index_t he = 0; he < n_half_edges_; he++)
+	bool * is_edge = new bool[n_half_edges_];
+	memset(is_edge, 0, sizeof(bool) * n_half_edges_);
+
+	// each edge key (min(v), max(v)) is paired by the thread owning min(v), half-edges are visited
+	// in increasing order and matched with the first free opposite, as the sequential scan does
+	#pragma omp parallel
 	{
-		if(OT[he] == NIL)
+		vector<pair<index_t, index_t> > v_he;	// (other vertex, he) for each he incident to v
+
+		#pragma omp for schedule(dynamic, 1024)
+		for(index_t v = 0; v < n_vertices_; v++)
 		{
-			et.push_back(he);
-			for(index_t h: he_p_vertex[VT[he]])
+			v_he.clear();
+			for(index_t i = he_v_off[v]; i < he_v_off[v + 1]; i++)
 			{
-				if(VT[prev(h)] == VT[next(he)])
+				const index_t & he = he_v[i];
+
+				if(VT[next(he)] >= v) v_he.push_back({VT[next(he)], he});
+				if(VT[prev(he)] > v) v_he.push_back({VT[prev(he)], prev(he)});
+			}
+
+			sort(v_he.begin(), v_he.end());
+
+			for(index_t i = 0, j; i < v_he.size(); i = j)
+			{
+				for(j = i + 1; j < v_he.size() && v_he[j].first == v_he[i].first; j++);
+
+				for(index_t k = i; k < j; k++)
 				{
-					if(OT[he] == NIL && OT[prev(h)] == NIL)
+					const index_t & he = v_he[k].second;
+					if(OT[he] != NIL) continue;
+
+					is_edge[he] = true;
+
+					index_t ohe = NIL;
+					for(index_t o = i; o < j; o++)
 					{
-						OT[he] = prev(h);
-						OT[prev(h)] = he;
+						const index_t & h = v_he[o].second;
+						if(OT[h] == NIL && VT[h] == VT[next(he)] && VT[next(h)] == VT[he])
+							if(ohe == NIL || next(h) < next(ohe)) ohe = h;
+					}
+
+					if(ohe != NIL)
+					{
+						OT[he] = ohe;
+						OT[ohe] = he;
 					}
 				}
 			}
 		}
 	}
-	
+
+	//edge table
+	n_edges_ = 0;
+
+	#pragma omp parallel for reduction(+: n_edges_)
+	for(index_t he = 0; he < n_half_edges_; he++)
+		n_edges_ += is_edge[he];
+
+	if(!in_arena(ET)) ET = new index_t[n_edges_];
+	for(index_t e = 0, he = 0; he < n_half_edges_; he++)
+		if(is_edge[he]) ET[e++] = he;
+
 	// non manifold two disk 
 	//for(index_t he = 0; he < n_half_edges_; he++)
 	//	if(OT[he] != NIL) assert(he == OT[OT[he]]);
 	
-	//edge table
-	n_edges_ = et.size();
-	ET = new index_t[n_edges_];
-	memcpy(ET, et.data(), sizeof(index_t) * n_edges_);
+	//extra vertex table: last he of v, its border he, or NIL if v has more than one border he
+	bool non_manifold = false;
+
+	#pragma omp parallel for reduction(||: non_manifold)
+	for(index_t v = 0; v < n_vertices_; v++)
+	{
+		if(he_v_off[v] == he_v_off[v + 1]) continue;
 
+		index_t n_border = 0;
+		EVT[v] = he_v[he_v_off[v + 1] - 1];
 
-	for(index_t he = 0; he < n_half_edges_; he++)
-		if(OT[he] == NIL && EVT[VT[he]] != NIL)
-		{
-			if(OT[EVT[VT[he]]] == NIL && EVT[VT[he]] != he)
+		for(index_t i = he_v_off[v]; i < he_v_off[v + 1]; i++)
+			if(OT[he_v[i]] == NIL)
 			{
-				manifold = false;
-				EVT[VT[he]] = NIL;
+				EVT[v] = he_v[i];
+				n_border++;
 			}
-			else EVT[VT[he]] = he;
+
+		if(n_border > 1)
+		{
+			non_manifold = true;
+			EVT[v] = NIL;
 		}
+	}
 
-//	for(index_t v = 0; v < n_vertices_; v++)
-//		if(EVT[v] >= n_half_edges_)
-//		{
-//			gproshan_debug_var(EVT[v]);
-//			assert(EVT[v] < n_half_edges_);
-//		}
+	if(non_manifold) manifold = false;
 
-	delete [] he_p_vertex;
+	delete [] he_v_off;
+	delete [] he_v_pos;
+	delete [] he_v;
+	delete [] is_edge;
 }
 
 void che::update_eht()
@@ -1391,7 +2215,9 @@ void che::update_bt()
 		}
 
 	n_borders_ = borders.size();
-	if(n_borders_)
+	if(in_arena(BT))	// reserved in the arena
+		memcpy(BT, borders.data(), sizeof(index_t) * n_borders_);
+	else if(n_borders_)
 	{
 		BT = new index_t[n_borders_];
 		memcpy(BT, borders.data(), sizeof(index_t) * n_borders_);
@@ -1401,15 +2227,268 @@ void che::update_bt()
 	delete [] border;
 }
 
+/// The rings are built by the first call, the acquire load of RO makes RV, RL and RS visible to the
+/// threads that did not build them.
+const index_t * che::rings_offsets()
+{
+	const index_t * ro = RO.load(memory_order_acquire);
+	if(ro) return ro;
+
+	update_rings();
+	return RO.load(memory_order_acquire);
+}
+
+void che::update_rings()
+{
+	#pragma omp critical (che_rings)
+	if(!RO.load(memory_order_relaxed))
+	{
+		index_t * offsets = new index_t[n_vertices_ + 1];
+		offsets[0] = 0;
+
+		#pragma omp parallel for
+		for(index_t v = 0; v < n_vertices_; v++)
+		{
+			index_t & n = offsets[v + 1] = 0;
+			for_star(he, this, v)
+				n += 1 + (OT[prev(he)] == NIL);
+		}
+
+		for(index_t v = 0; v < n_vertices_; v++)
+			offsets[v + 1] += offsets[v];
+
+		RV = new index_t[offsets[n_vertices_]];
+		RL = new index_t[offsets[n_vertices_]];
+		RS = new index_t[offsets[n_vertices_]];
+
+		#pragma omp parallel for
+		for(index_t v = 0; v < n_vertices_; v++)
+		{
+			index_t i = offsets[v];
+			for_star(he, this, v)
+			{
+				RS[i] = he;
+				RL[i] = next(he);
+				RV[i++] = VT[next(he)];
+
+				if(OT[prev(he)] == NIL)
+				{
+					RS[i] = NIL;
+					RL[i] = prev(he);
+					RV[i++] = VT[prev(he)];
+				}
+			}
+		}
+
+		RO.store(offsets, memory_order_release);
+	}
+}
+
+/// The caches are published by the release store of dirty = false.
+void che::update_attributes()
+{
+	#pragma omp critical (che_attributes)
+	if(dirty.load(memory_order_acquire))
+	{
+		if(!FA)
+		{
+			FA = new area_t[n_faces_];
+			FN = new vertex[n_faces_];
+			VA = new area_t[n_vertices_];
+			VN = new vertex[n_vertices_];
+		}
+
+		che_soa soa(this);
+		soa.area_trigs(FA);
+		soa.normal_trigs(FN);
+
+		#pragma omp parallel for
+		for(index_t v = 0; v < n_vertices_; v++)
+		{
+			vertex n;
+			area_t area_star = 0;
+
+			for_star(he, this, v)
+			{
+				area_star += FA[trig(he)];
+				n += FA[trig(he)] * FN[trig(he)];
+			}
+
+			VA[v] = area_star / 3;
+			VN[v] = n / *n;
+		}
+
+		dirty.store(false, memory_order_release);
+	}
+}
+
+void che::delete_attributes()
+{
+	if(FA) delete [] FA;
+	if(FN) delete [] FN;
+	if(VA) delete [] VA;
+	if(VN) delete [] VN;
+
+	FA = VA = nullptr;
+	FN = VN = nullptr;
+	dirty = true;
+}
+
+void che::delete_rings()
+{
+	if(RO) delete [] RO.load();
+	if(RV) delete [] RV;
+	if(RL) delete [] RL;
+	if(RS) delete [] RS;
+
+	RO = RV = RL = RS = nullptr;
+}
+
 void che::delete_me()
 {
-	if(GT)	delete [] GT;
-	if(VT)	delete [] VT;
-	if(OT)	delete [] OT;
-	if(EVT)	delete [] EVT;
-	if(ET)	delete [] ET;
-	if(EHT)	delete [] EHT;
-	if(BT)	delete [] BT;
+	delete_tables();
+
+	free(arena);
+	arena = nullptr;
+	arena_size = 0;
+}
+
+// it keeps the arena to be reused by init
+void che::delete_tables()
+{
+	delete_rings();
+	delete_attributes();
+
+	// the shared tables are released by their last owner
+	if(shared_gt.use_count()) shared_gt.reset();
+	else if(!in_arena(GT)) delete [] GT;
+
+	if(shared_vt.use_count()) shared_vt.reset();
+	else if(!in_arena(VT)) delete [] VT;
+
+	if(shared_ot.use_count()) shared_ot.reset();
+	else
+	{
+		if(!in_arena(OT))	delete [] OT;
+		if(!in_arena(EVT))	delete [] EVT;
+		if(!in_arena(ET))	delete [] ET;
+		if(!in_arena(EHT))	delete [] EHT;
+		if(!in_arena(BT))	delete [] BT;
+	}
+
+	GT = nullptr;
+	VT = OT = EVT = ET = EHT = BT = nullptr;
+}
+
+void che::alloc_tables()
+{
+	// the borrowed tables are not allocated
+	const size_t sizes[7] = {	shared_gt.use_count() ? 0 : n_vertices_ * sizeof(vertex),
+								shared_vt.use_count() ? 0 : n_half_edges_ * sizeof(index_t),
+								n_half_edges_ * sizeof(index_t),
+								n_vertices_ * sizeof(index_t),
+								n_half_edges_ * sizeof(index_t),
+								n_half_edges_ * sizeof(index_t),
+								n_vertices_ * sizeof(index_t)
+								};
+
+	void * tables[7];
+	arena_tables(arena, arena_size, tables, sizes);
+
+	if(sizes[0]) GT = (vertex *) tables[0];
+	if(sizes[1]) VT = (index_t *) tables[1];
+	OT	= (index_t *) tables[2];
+	EVT	= (index_t *) tables[3];
+	EHT	= (index_t *) tables[4];
+	ET	= (index_t *) tables[5];
+	BT	= (index_t *) tables[6];
+}
+
+bool che::in_arena(const void * p) const
+{
+	return arena && (const char *) p >= arena && (const char *) p < arena + arena_size;
+}
+
+// the owned tables become shared, they are deleted by the last mesh sharing them, the arena is freed when all
+// the tables stored in it are released. It changes the owners of a const mesh: the copies of a mesh are
+// serialized, they must not run at the same time than an edit of the mesh.
+void che::share() const
+{
+	#pragma omp critical (che_share)
+	share_tables();
+}
+
+void che::share_tables() const
+{
+	shared_ptr<void> shared_arena;
+	if(arena) shared_arena = shared_ptr<void>(arena, free);
+
+	if(!shared_gt.use_count())
+	{
+		vertex * table = in_arena(GT) ? nullptr : GT;
+		shared_gt = shared_ptr<void>(GT, [table, shared_arena](void *) { delete [] table; });
+	}
+
+	if(!shared_vt.use_count())
+	{
+		index_t * table = in_arena(VT) ? nullptr : VT;
+		shared_vt = shared_ptr<void>(VT, [table, shared_arena](void *) { delete [] table; });
+	}
+
+	if(!shared_ot.use_count())
+	{
+		index_t * tables[5] = {OT, EVT, ET, EHT, BT};
+		for(index_t *& t: tables)
+			if(in_arena(t)) t = nullptr;
+
+		shared_ot = shared_ptr<void>(OT, [tables, shared_arena](void *)
+								{
+									for(index_t * t: tables)
+										delete [] t;
+								});
+	}
+
+	arena = nullptr;
+	arena_size = 0;
+}
+
+template<class T>
+static void copy_table(T *& table, const size_t & n)
+{
+	if(!table) return;
+
+	T * copy = new T[n];
+	memcpy(copy, table, n * sizeof(T));
+	table = copy;
+}
+
+// copy on write: the shared or borrowed tables are copied before editing them
+void che::detach_gt()
+{
+	if(!shared_gt.use_count()) return;
+
+	copy_table(GT, n_vertices_);
+	shared_gt.reset();
+}
+
+void che::detach_vt()
+{
+	if(!shared_vt.use_count()) return;
+
+	copy_table(VT, n_half_edges_);
+	shared_vt.reset();
+}
+
+void che::detach_ot()
+{
+	if(!shared_ot.use_count()) return;
+
+	copy_table(OT, n_half_edges_);
+	copy_table(EVT, n_vertices_);
+	copy_table(ET, n_edges_);
+	copy_table(EHT, n_half_edges_);
+	copy_table(BT, n_borders_);
+	shared_ot.reset();
 }
 
 void che::read_file(const string & )
@@ -0,0 +1,297 @@
+#include "che_bin.h"
+
+#include <fstream>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+
+// geometry processing and shape analysis framework
+namespace gproshan {
+
+
+static const char che_bin_magic[8] = {'G', 'P', 'R', 'O', 'S', 'H', 'A', 'N'};
+
+static const uint64_t fnv_offset = 14695981039346656037ULL;
+static const uint64_t fnv_prime = 1099511628211ULL;
+static const size_t hash_block = 1 << 20;		///< bytes, fixed: the hash does not depend on the threads
+
+
+che_bin::che_bin(const string & file, const bool & check_): check(check_)
+{
+	init(file);
+}
+
+che_bin::che_bin(const che_bin & mesh): che(mesh), check(mesh.check)
+{
+}
+
+che_bin::~che_bin()
+{
+}
+
+void che_bin::read_file(const string & file)
+{
+	init(0, 0);
+
+	header_t header;
+	if(!read_header(header, file)) return;
+
+	int fd = open(file.c_str(), O_RDONLY);
+	if(fd < 0)
+	{
+		gproshan_error_var(file);
+		return;
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) < 0)
+	{
+		close(fd);
+		gproshan_error_var(file);
+		return;
+	}
+
+	// private mapping: the mesh can be edited in memory (copy on write) without modifying the file
+	const size_t map_size = st.st_size;
+	void * map_addr = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if(map_addr == MAP_FAILED)
+	{
+		gproshan_error_var(file);
+		return;
+	}
+
+	// the mapping is shared by all the tables and the copies of the mesh, the last one unmaps it
+	shared_gt = shared_vt = shared_ot = shared_ptr<void>(map_addr, [map_size](void * p) { munmap(p, map_size); });
+
+	n_vertices_		= header.n_vertices;
+	n_faces_		= header.n_faces;
+	n_half_edges_	= header.n_half_edges;
+	n_edges_		= header.n_edges;
+	n_borders_		= header.n_borders;
+	manifold		= header.manifold;
+
+	auto invalid = [&]()
+	{
+		gproshan_error(corrupt che file);
+		gproshan_error_var(file);
+		delete_me();
+		init(0, 0);
+	};
+
+	if(header.n_half_edges != che::P * header.n_faces || header.n_edges > header.n_half_edges || header.n_borders > header.n_vertices)
+	{
+		invalid();
+		return;
+	}
+
+	// a corrupt header must not overflow the sizes nor the offsets
+	const size_t counts[7] = {n_vertices_, n_half_edges_, n_half_edges_, n_vertices_, n_edges_, n_half_edges_, n_borders_};
+	const size_t elem_size[7] = {sizeof(vertex), sizeof(index_t), sizeof(index_t), sizeof(index_t), sizeof(index_t), sizeof(index_t), sizeof(index_t)};
+
+	void * tables[7];
+	for(index_t i = 0; i < 7; i++)
+	{
+		if(header.offset[i] > map_size || counts[i] > (map_size - header.offset[i]) / elem_size[i])
+		{
+			invalid();
+			return;
+		}
+
+		tables[i] = counts[i] ? (char *) map_addr + header.offset[i] : nullptr;
+	}
+
+	GT	= (vertex *) tables[0];
+	VT	= (index_t *) tables[1];
+	OT	= (index_t *) tables[2];
+	EVT	= (index_t *) tables[3];
+	ET	= (index_t *) tables[4];
+	EHT	= (index_t *) tables[5];
+	BT	= (index_t *) tables[6];
+
+	if(check && !verify(this, header.hash)) invalid();
+}
+
+bool che_bin::write_file(const che * mesh, const string & file)
+{
+	header_t header;
+	memcpy(header.magic, che_bin_magic, sizeof(header.magic));
+
+	header.version		= version;
+	header.size_index	= sizeof(index_t);
+	header.size_real	= sizeof(real_t);
+	header.manifold		= mesh->manifold;
+	header.n_vertices	= mesh->n_vertices_;
+	header.n_faces		= mesh->n_faces_;
+	header.n_half_edges	= mesh->n_half_edges_;
+	header.n_edges		= mesh->n_edges_;
+	header.n_borders	= mesh->n_borders_;
+	header.hash			= hash(mesh);
+
+	const void * tables[7] = {mesh->GT, mesh->VT, mesh->OT, mesh->EVT, mesh->ET, mesh->EHT, mesh->BT};
+	const size_t sizes[7] = {	mesh->n_vertices_ * sizeof(vertex),
+								mesh->n_half_edges_ * sizeof(index_t),
+								mesh->n_half_edges_ * sizeof(index_t),
+								mesh->n_vertices_ * sizeof(index_t),
+								mesh->n_edges_ * sizeof(index_t),
+								mesh->n_half_edges_ * sizeof(index_t),
+								mesh->n_borders_ * sizeof(index_t)
+								};
+
+	size_t offset = sizeof(header_t);
+	for(index_t i = 0; i < 7; i++)
+	{
+		offset = (offset + align - 1) / align * align;
+		header.offset[i] = offset;
+		offset += sizes[i];
+	}
+
+	ofstream os(file + ".che", ios::binary);
+
+	os.write((char *) &header, sizeof(header_t));
+
+	char padding[align] = {};
+	for(index_t i = 0; i < 7; i++)
+	{
+		os.write(padding, header.offset[i] - os.tellp());
+		if(sizes[i]) os.write((const char *) tables[i], sizes[i]);
+	}
+
+	os.close();
+
+	if(os.fail())
+	{
+		gproshan_error_var(file);
+		return false;
+	}
+
+	return true;
+}
+
+bool che_bin::read_header(header_t & header, const string & file)
+{
+	ifstream is(file, ios::binary);
+
+	if(!is.read((char *) &header, sizeof(header_t)) || memcmp(header.magic, che_bin_magic, sizeof(header.magic)))
+	{
+		gproshan_error(not a che file);
+		return false;
+	}
+
+	if(header.version != version)
+	{
+		gproshan_error_var(header.version);
+		return false;
+	}
+
+	if(header.size_index != sizeof(index_t) || header.size_real != sizeof(real_t))
+	{
+		gproshan_error(che file written with a different index_t or real_t size: check INDEX_64 and SINGLE_P in config.h);
+		gproshan_error_var(header.size_index);
+		gproshan_error_var(header.size_real);
+		return false;
+	}
+
+	return true;
+}
+
+/// FNV-1a of the 64 bits words of data, the last word is padded with zeros.
+static uint64_t fnv1a_words(const char * data, const size_t & n)
+{
+	uint64_t h = fnv_offset;
+	uint64_t w;
+
+	size_t i = 0;
+	for(; i + sizeof(w) <= n; i += sizeof(w))
+	{
+		memcpy(&w, data + i, sizeof(w));
+		h = (h ^ w) * fnv_prime;
+	}
+
+	if(i < n)
+	{
+		w = 0;
+		memcpy(&w, data + i, n - i);
+		h = (h ^ w) * fnv_prime;
+	}
+
+	return h;
+}
+
+/// The hashes of the blocks of hash_block bytes of each table are combined in order.
+uint64_t che_bin::hash(const che * mesh)
+{
+	const char * tables[7] = {(const char *) mesh->GT, (const char *) mesh->VT, (const char *) mesh->OT, (const char *) mesh->EVT, (const char *) mesh->ET, (const char *) mesh->EHT, (const char *) mesh->BT};
+	const size_t sizes[7] = {	mesh->n_vertices_ * sizeof(vertex),
+								mesh->n_half_edges_ * sizeof(index_t),
+								mesh->n_half_edges_ * sizeof(index_t),
+								mesh->n_vertices_ * sizeof(index_t),
+								mesh->n_edges_ * sizeof(index_t),
+								mesh->n_half_edges_ * sizeof(index_t),
+								mesh->n_borders_ * sizeof(index_t)
+								};
+
+	uint64_t h = fnv_offset;
+	vector<uint64_t> blocks;
+
+	for(index_t i = 0; i < 7; i++)
+	{
+		blocks.resize((sizes[i] + hash_block - 1) / hash_block);
+
+		#pragma omp parallel for
+		for(index_t b = 0; b < blocks.size(); b++)
+			blocks[b] = fnv1a_words(tables[i] + b * hash_block, min<size_t>(hash_block, sizes[i] - b * hash_block));
+
+		for(const uint64_t & hb: blocks)
+			h = (h ^ hb) * fnv_prime;
+	}
+
+	return h;
+}
+
+bool che_bin::verify(const che * mesh, const uint64_t & hash)
+{
+	if(che_bin::hash(mesh) != hash)
+	{
+		gproshan_error(the hash of the che tables does not match);
+		return false;
+	}
+
+	const size_t n_v = mesh->n_vertices_;
+	const size_t n_he = mesh->n_half_edges_;
+	const size_t n_e = mesh->n_edges_;
+
+	bool valid = true;
+
+	#pragma omp parallel for reduction(&&: valid)
+	for(index_t he = 0; he < n_he; he++)
+		valid = valid && mesh->VT[he] < n_v && (mesh->OT[he] < n_he || mesh->OT[he] == NIL) && mesh->EHT[he] < n_e;
+
+	#pragma omp parallel for reduction(&&: valid)
+	for(index_t v = 0; v < n_v; v++)
+		valid = valid && (mesh->EVT[v] < n_he || mesh->EVT[v] == NIL);
+
+	#pragma omp parallel for reduction(&&: valid)
+	for(index_t e = 0; e < n_e; e++)
+		valid = valid && mesh->ET[e] < n_he;
+
+	for(index_t b = 0; b < mesh->n_borders_; b++)
+		valid = valid && mesh->BT[b] < n_v;
+
+	if(!valid) gproshan_error(the topology tables of the che file reference invalid elements);
+
+	return valid;
+}
+
+
+} // namespace gproshan
+
@@ -0,0 +1,672 @@
+#include "che_gpz.h"
+
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <cmath>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+
+// geometry processing and shape analysis framework
+namespace gproshan {
+
+
+static const char che_gpz_magic[8] = {'G', 'P', 'M', 'E', 'S', 'H', 'Z', '\0'};
+
+
+// adaptive binary range coder (as LZMA): 11 bits probabilities of the bit 0, adapted with shift 5
+
+static const uint32_t rc_top = 1 << 24;
+static const uint16_t rc_half = 1 << 10;
+
+struct rc_encoder
+{
+	vector<uint8_t> out;
+	uint64_t low = 0;
+	uint32_t range = 0xFFFFFFFF;
+	uint8_t cache = 0;
+	uint64_t cache_size = 1;
+
+	void shift_low()
+	{
+		if(uint32_t(low) < 0xFF000000 || (low >> 32))
+		{
+			const uint8_t carry = low >> 32;
+			uint8_t byte = cache;
+			do
+			{
+				out.push_back(byte + carry);
+				byte = 0xFF;
+			}
+			while(--cache_size);
+
+			cache = (low >> 24) & 0xFF;
+		}
+
+		cache_size++;
+		low = (low & 0x00FFFFFF) << 8;
+	}
+
+	void bit(uint16_t & p, const bool & b)
+	{
+		const uint32_t bound = (range >> 11) * p;
+
+		if(!b)
+		{
+			range = bound;
+			p += (2048 - p) >> 5;
+		}
+		else
+		{
+			low += bound;
+			range -= bound;
+			p -= p >> 5;
+		}
+
+		if(range < rc_top)
+		{
+			range <<= 8;
+			shift_low();
+		}
+	}
+
+	void direct(const uint64_t & value, const unsigned int & n)
+	{
+		for(unsigned int i = n; i--; )
+		{
+			range >>= 1;
+			if((value >> i) & 1) low += range;
+
+			if(range < rc_top)
+			{
+				range <<= 8;
+				shift_low();
+			}
+		}
+	}
+
+	void flush()
+	{
+		for(index_t i = 0; i < 5; i++)
+			shift_low();
+	}
+};
+
+struct rc_decoder
+{
+	const uint8_t * p;
+	const uint8_t * end;
+	uint32_t range = 0xFFFFFFFF;
+	uint32_t code = 0;
+	bool overrun = false;		///< read past the end: truncated stream
+
+	rc_decoder(const uint8_t * begin, const uint8_t * end_): p(begin), end(end_)
+	{
+		for(index_t i = 0; i < 5; i++)
+			code = (code << 8) | next();
+	}
+
+	uint8_t next()
+	{
+		if(p < end) return *p++;
+
+		overrun = true;
+		return 0;
+	}
+
+	bool bit(uint16_t & prob)
+	{
+		const uint32_t bound = (range >> 11) * prob;
+		bool b;
+
+		if(code < bound)
+		{
+			range = bound;
+			prob += (2048 - prob) >> 5;
+			b = 0;
+		}
+		else
+		{
+			code -= bound;
+			range -= bound;
+			prob -= prob >> 5;
+			b = 1;
+		}
+
+		if(range < rc_top)
+		{
+			range <<= 8;
+			code = (code << 8) | next();
+		}
+
+		return b;
+	}
+
+	uint64_t direct(const unsigned int & n)
+	{
+		uint64_t value = 0;
+		for(unsigned int i = 0; i < n; i++)
+		{
+			range >>= 1;
+			const bool b = code >= range;
+			if(b) code -= range;
+			value = (value << 1) | b;
+
+			if(range < rc_top)
+			{
+				range <<= 8;
+				code = (code << 8) | next();
+			}
+		}
+
+		return value;
+	}
+};
+
+/// Adaptive model of unsigned integers: the bit length of u + 1 is coded with a bit tree,
+/// the bits below the leading one are direct bits.
+struct uint_model
+{
+	uint16_t p[64];
+
+	uint_model()
+	{
+		fill(p, p + 64, rc_half);
+	}
+
+	void encode(rc_encoder & rc, const uint64_t & u)
+	{
+		const uint64_t x = u + 1;
+		const unsigned int n = 63 - __builtin_clzll(x);
+
+		for(unsigned int i = 6, node = 1; i--; )
+		{
+			const bool b = (n >> i) & 1;
+			rc.bit(p[node], b);
+			node = (node << 1) | b;
+		}
+
+		rc.direct(x, n);
+	}
+
+	uint64_t decode(rc_decoder & rc)
+	{
+		unsigned int node = 1;
+		for(index_t i = 0; i < 6; i++)
+			node = (node << 1) | rc.bit(p[node]);
+
+		const unsigned int n = node - 64;
+		return ((uint64_t(1) << n) | rc.direct(n)) - 1;
+	}
+};
+
+static inline uint64_t zigzag(const int64_t & x)
+{
+	return (uint64_t(x) << 1) ^ uint64_t(x >> 63);
+}
+
+static inline int64_t unzigzag(const uint64_t & u)
+{
+	return int64_t(u >> 1) ^ -int64_t(u & 1);
+}
+
+/// Models of the connectivity and geometry symbols, the same in the encoder and the decoder.
+struct gpz_models
+{
+	uint16_t gate[2] = {rc_half, rc_half};	///< the gate has the next face, by context: gate still open
+	uint16_t tip_new = rc_half;				///< the tip is a new vertex
+	uint16_t tip_left = rc_half;			///< the tip is in the open border of the gate origin (L)
+	uint16_t tip_right = rc_half;			///< the tip is in the open border of the gate end (R)
+	uint16_t seed_new = rc_half;			///< a vertex of a seed face is a new vertex
+	uint_model candidate;					///< position of the tip in the border list (L, R)
+	uint_model reference;					///< back reference to a coded vertex
+	uint_model parallelogram[3];			///< residuals by axis of the parallelogram prediction
+	uint_model delta[3];					///< residuals by axis of the previous vertex prediction
+};
+
+/*!
+	Open border of the coded faces: the coded directed edges a -> b whose opposite b -> a is not
+	coded yet, as lists out[a] (of b) and in[b] (of a) in a pool of nodes. The encoder and the
+	decoder update it with the same operations, so the positions in the lists are the same.
+*/
+struct gpz_border
+{
+	struct node_t
+	{
+		index_t v;
+		index_t next;
+	};
+
+	vector<node_t> nodes;
+	vector<index_t> in;
+	vector<index_t> out;
+	index_t free = NIL;
+
+	gpz_border(const size_t & n_vertices): in(n_vertices, NIL), out(n_vertices, NIL) {}
+
+	index_t find(const index_t & head, const index_t & v) const
+	{
+		index_t k = 0;
+		for(index_t i = head; i != NIL; i = nodes[i].next, k++)
+			if(nodes[i].v == v) return k;
+
+		return NIL;
+	}
+
+	index_t at(const index_t & head, index_t k) const
+	{
+		index_t i = head;
+		while(i != NIL && k--) i = nodes[i].next;
+		return i != NIL ? nodes[i].v : NIL;
+	}
+
+	void insert(index_t & head, const index_t & v)
+	{
+		index_t i = free;
+		if(i != NIL) free = nodes[i].next;
+		else
+		{
+			i = nodes.size();
+			nodes.push_back({});
+		}
+
+		nodes[i] = {v, head};
+		head = i;
+	}
+
+	bool erase(index_t & head, const index_t & v)
+	{
+		for(index_t * i = &head; *i != NIL; i = &nodes[*i].next)
+			if(nodes[*i].v == v)
+			{
+				const index_t j = *i;
+				*i = nodes[j].next;
+				nodes[j].next = free;
+				free = j;
+				return true;
+			}
+
+		return false;
+	}
+
+	bool is_open(const index_t & a, const index_t & b) const
+	{
+		return find(out[a], b) != NIL;
+	}
+
+	void add_edge(const index_t & a, const index_t & b)
+	{
+		if(erase(out[b], a)) erase(in[a], b);
+		else
+		{
+			insert(out[a], b);
+			insert(in[b], a);
+		}
+	}
+
+	void add_face(const index_t & a, const index_t & b, const index_t & c)
+	{
+		add_edge(a, b);
+		add_edge(b, c);
+		add_edge(c, a);
+	}
+};
+
+
+che_gpz::che_gpz(const string & file)
+{
+	init(file);
+}
+
+che_gpz::che_gpz(const che_gpz & mesh): che(mesh)
+{
+}
+
+void che_gpz::read_file(const string & file)
+{
+	init(0, 0);
+
+	int fd = open(file.c_str(), O_RDONLY);
+	if(fd < 0)
+	{
+		gproshan_error_var(file);
+		return;
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) < 0)
+	{
+		close(fd);
+		gproshan_error_var(file);
+		return;
+	}
+
+	const size_t map_size = st.st_size;
+	void * map_addr = map_size >= sizeof(header_t) ? mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	close(fd);
+
+	if(map_addr == MAP_FAILED)
+	{
+		gproshan_error_var(file);
+		return;
+	}
+
+	madvise(map_addr, map_size, MADV_SEQUENTIAL);
+
+	header_t header;
+	memcpy(&header, map_addr, sizeof(header_t));
+
+	// a symbol takes 1/64 bits at least (the probabilities are in [31, 2017] / 2048), a vertex is 3 symbols
+	// and a face 1 at least: larger n_vertices or n_faces are not in the stream
+	const uint64_t max_symbols = 512 * header.size;
+
+	bool valid = !memcmp(header.magic, che_gpz_magic, sizeof(header.magic)) && header.version == version;
+	valid = valid && header.size <= map_size - sizeof(header_t);
+	valid = valid && header.bits >= 1 && header.bits <= 31;
+	valid = valid && header.n_vertices < NIL && header.n_vertices <= max_symbols;
+	valid = valid && header.n_faces < NIL / che::P && header.n_faces <= max_symbols;
+	for(index_t i = 0; i < 3; i++)
+		valid = valid && isfinite(header.min[i]) && isfinite(header.step[i]) && header.step[i] > 0;
+
+	if(!valid)
+	{
+		gproshan_error(not a valid gpz file);
+		gproshan_error_var(file);
+		munmap(map_addr, map_size);
+		return;
+	}
+
+	const size_t n_v = header.n_vertices;
+	const size_t n_f = header.n_faces;
+
+	init(n_v, n_f);
+
+	const uint8_t * data = (const uint8_t *) map_addr + sizeof(header_t);
+	rc_decoder rc(data, data + header.size);
+	gpz_models models;
+	gpz_border border(n_v);
+
+	int64_t * q = new int64_t[3 * n_v];
+	index_t n_decoded = 0;
+	index_t he = 0;
+
+	const int64_t q_end = int64_t(1) << header.bits;		// the quantized coordinates are in [0, q_end)
+
+	struct gate_t { index_t a, b, c; };
+	vector<gate_t> gates;
+
+	auto new_vertex = [&](const int64_t * pred, uint_model * model) -> index_t
+	{
+		if(n_decoded == n_v)
+		{
+			valid = false;
+			return 0;
+		}
+
+		int64_t * p = q + 3 * n_decoded;
+		for(index_t i = 0; i < 3; i++)
+		{
+			p[i] = pred[i] + unzigzag(model[i].decode(rc));
+			valid = valid && p[i] >= 0 && p[i] < q_end;
+		}
+
+		return n_decoded++;
+	};
+
+	auto reference = [&]() -> index_t
+	{
+		const uint64_t r = models.reference.decode(rc);
+		if(r >= n_decoded)
+		{
+			valid = false;
+			return 0;
+		}
+
+		return n_decoded - 1 - r;
+	};
+
+	const int64_t zero[3] = {};
+	auto last = [&]() { return n_decoded ? q + 3 * (n_decoded - 1) : zero; };
+
+	while(valid && he < n_half_edges_)
+	{
+		// seed face of a connected component
+		index_t s[3];
+		for(index_t i = 0; i < 3; i++)
+			s[i] = rc.bit(models.seed_new) ? new_vertex(last(), models.delta) : reference();
+
+		VT[he++] = s[0]; VT[he++] = s[1]; VT[he++] = s[2];
+		border.add_face(s[0], s[1], s[2]);
+
+		gates.push_back({s[2], s[0], s[1]});
+		gates.push_back({s[1], s[2], s[0]});
+		gates.push_back({s[0], s[1], s[2]});
+
+		while(valid && !gates.empty())
+		{
+			const gate_t g = gates.back();
+			gates.pop_back();
+
+			if(!rc.bit(models.gate[border.is_open(g.a, g.b)])) continue;
+
+			if(he == n_half_edges_)
+			{
+				valid = false;
+				break;
+			}
+
+			index_t t;
+			if(rc.bit(models.tip_new))
+			{
+				int64_t pred[3];
+				for(index_t i = 0; i < 3; i++)
+					pred[i] = q[3 * g.a + i] + q[3 * g.b + i] - q[3 * g.c + i];
+
+				t = new_vertex(pred, models.parallelogram);
+			}
+			else if(rc.bit(models.tip_left))
+				t = border.at(border.in[g.a], models.candidate.decode(rc));
+			else if(rc.bit(models.tip_right))
+				t = border.at(border.out[g.b], models.candidate.decode(rc));
+			else
+				t = reference();
+
+			if(t == NIL)
+			{
+				valid = false;
+				break;
+			}
+
+			VT[he++] = g.b; VT[he++] = g.a; VT[he++] = t;
+			border.add_face(g.b, g.a, t);
+
+			gates.push_back({g.a, t, g.b});
+			gates.push_back({t, g.b, g.a});
+		}
+	}
+
+	// isolated vertices
+	while(valid && n_decoded < n_v)
+		new_vertex(last(), models.delta);
+
+	if(!valid || rc.overrun)
+	{
+		gproshan_error(corrupted gpz file);
+		gproshan_error_var(file);
+		delete [] q;
+		munmap(map_addr, map_size);
+		delete_me();
+		init(0, 0);
+		return;
+	}
+
+	#pragma omp parallel for
+	for(index_t v = 0; v < n_v; v++)
+	for(index_t i = 0; i < 3; i++)
+		GT[v][i] = header.min[i] + q[3 * v + i] * header.step[i];
+
+	delete [] q;
+	munmap(map_addr, map_size);
+}
+
+bool che_gpz::write_file(const che * mesh, const string & file, const unsigned int & bits)
+{
+	const size_t n_v = mesh->n_vertices();
+	const size_t n_f = mesh->n_faces();
+
+	header_t header;
+	memcpy(header.magic, che_gpz_magic, sizeof(header.magic));
+	header.version = version;
+	header.bits = bits < 1 ? 1 : bits > 31 ? 31 : bits;
+	header.n_vertices = n_v;
+	header.n_faces = n_f;
+
+	// quantization in the bounding box
+	double max[3];
+	for(index_t i = 0; i < 3; i++)
+	{
+		header.min[i] = n_v ? INFINITY : 0;
+		max[i] = n_v ? -INFINITY : 0;
+	}
+
+	for(index_t v = 0; v < n_v; v++)
+	for(index_t i = 0; i < 3; i++)
+	{
+		header.min[i] = min(header.min[i], double(mesh->gt(v)[i]));
+		max[i] = std::max(max[i], double(mesh->gt(v)[i]));
+	}
+
+	const double n_steps = (uint64_t(1) << header.bits) - 1;
+	for(index_t i = 0; i < 3; i++)
+		header.step[i] = max[i] > header.min[i] ? (max[i] - header.min[i]) / n_steps : 1;
+
+	int64_t * q = new int64_t[3 * n_v];
+
+	#pragma omp parallel for
+	for(index_t v = 0; v < n_v; v++)
+	for(index_t i = 0; i < 3; i++)
+		q[3 * v + i] = llround((mesh->gt(v)[i] - header.min[i]) / header.step[i]);
+
+	rc_encoder rc;
+	rc.out.reserve(n_f + 4 * n_v);
+	gpz_models models;
+	gpz_border border(n_v);
+
+	vector<index_t> id(n_v, NIL);		// v -> coded v
+	vector<bool> coded(n_f, false);
+	vector<index_t> gates;				// mesh he of coded faces
+	index_t n_coded = 0;
+	int64_t last[3] = {};
+
+	auto new_vertex = [&](const index_t & v, const int64_t * pred, uint_model * model)
+	{
+		for(index_t i = 0; i < 3; i++)
+			model[i].encode(rc, zigzag(q[3 * v + i] - pred[i]));
+
+		memcpy(last, q + 3 * v, sizeof(last));
+		id[v] = n_coded++;
+	};
+
+	for(index_t f = 0; f < n_f; f++)
+	{
+		if(coded[f]) continue;
+
+		// seed face of a connected component
+		for(index_t he = f * che::P; he < (f + 1) * che::P; he++)
+		{
+			const index_t & v = mesh->vt(he);
+			rc.bit(models.seed_new, id[v] == NIL);
+
+			if(id[v] == NIL) new_vertex(v, last, models.delta);
+			else models.reference.encode(rc, n_coded - 1 - id[v]);
+		}
+
+		coded[f] = true;
+		border.add_face(id[mesh->vt(f * che::P)], id[mesh->vt(f * che::P + 1)], id[mesh->vt(f * che::P + 2)]);
+
+		gates.push_back(f * che::P + 2);
+		gates.push_back(f * che::P + 1);
+		gates.push_back(f * che::P);
+
+		while(!gates.empty())
+		{
+			const index_t he = gates.back();
+			gates.pop_back();
+
+			const index_t & a = mesh->vt(he);
+			const index_t & b = mesh->vt(next(he));
+			const index_t & c = mesh->vt(prev(he));
+
+			// the opposite face is coded as (b, a, t), if it has the same orientation
+			const index_t & ohe = mesh->ot(he);
+			const bool face = ohe != NIL && !coded[trig(ohe)] && mesh->vt(ohe) == b && mesh->vt(next(ohe)) == a;
+
+			rc.bit(models.gate[border.is_open(id[a], id[b])], face);
+			if(!face) continue;
+
+			const index_t & t = mesh->vt(prev(ohe));
+			rc.bit(models.tip_new, id[t] == NIL);
+
+			if(id[t] == NIL)
+			{
+				int64_t pred[3];
+				for(index_t i = 0; i < 3; i++)
+					pred[i] = q[3 * a + i] + q[3 * b + i] - q[3 * c + i];
+
+				new_vertex(t, pred, models.parallelogram);
+			}
+			else
+			{
+				index_t k = border.find(border.in[id[a]], id[t]);
+				rc.bit(models.tip_left, k != NIL);
+
+				if(k == NIL)
+				{
+					k = border.find(border.out[id[b]], id[t]);
+					rc.bit(models.tip_right, k != NIL);
+				}
+
+				if(k != NIL) models.candidate.encode(rc, k);
+				else models.reference.encode(rc, n_coded - 1 - id[t]);
+			}
+
+			coded[trig(ohe)] = true;
+			border.add_face(id[b], id[a], id[t]);
+
+			gates.push_back(next(ohe));		// a -> t
+			gates.push_back(prev(ohe));		// t -> b
+		}
+	}
+
+	// isolated vertices
+	for(index_t v = 0; v < n_v; v++)
+		if(id[v] == NIL) new_vertex(v, last, models.delta);
+
+	rc.flush();
+	delete [] q;
+
+	header.size = rc.out.size();
+
+	ofstream os(file + ".gpz", ios::binary);
+	os.write((char *) &header, sizeof(header_t));
+	os.write((char *) rc.out.data(), rc.out.size());
+	os.close();
+
+	if(os.fail())
+	{
+		gproshan_error_var(file);
+		return false;
+	}
+
+	return true;
+}
+
+
+} // namespace gproshan
+
@@ -1,5 +1,7 @@
 #include "che_img.h"
 
+#include "file_writer.h"
+
 #include <fstream>
 #include <vector>
 #include <cstring>
@@ -56,24 +58,27 @@ void che_img::read_file(const string & file)
 	thread([](CImg<real_t> img) { img.display(); }, img).detach();
 }
 
-void che_img::write_file(const string & file) const
+bool che_img::write_file(const string & file) const
 {
-	ofstream os(file);
+	file_writer os(file);
 
-	os << "OFF" << endl;
-	os << n_vertices_ << " " << n_faces_ << " 0" << endl;
+	os << "OFF\n";
+	os << n_vertices_ << ' ' << n_faces_ << " 0\n";
 
-	for(size_t v = 0; v < n_vertices_; v++)
-		os << GT[v] << endl;
+	os.write_records(n_vertices_, [&](out_buffer & out, const index_t & v)
+	{
+		out << GT[v] << '\n';
+	});
 
-	for(index_t he = 0; he < n_half_edges_; he++)
+	os.write_records(n_faces_, [&](out_buffer & out, const index_t & f)
 	{
-		if(!(he % che::P)) os << che::P;
-		os << " " << VT[he];
-		if(he % che::P == che::P - 1) os << endl;
-	}
+		out << che::P;
+		for(index_t i = 0; i < che::P; i++)
+			out << ' ' << VT[f * che::P + i];
+		out << '\n';
+	});
 
-	os.close();
+	return os.flush();
 }
 
 
@@ -0,0 +1,179 @@
+#include "che_io.h"
+
+#include "che_off.h"
+#include "che_obj.h"
+#include "che_ply.h"
+#include "che_bin.h"
+#include "che_gpz.h"
+#include "che_img.h"
+
+#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <cctype>
+
+#include <omp.h>
+
+using namespace std;
+
+
+// geometry processing and shape analysis framework
+namespace gproshan {
+
+
+static vector<che_format_t> & registry()
+{
+	static vector<che_format_t> formats = {
+		{	"off", {"off"}, {"OFF", "COFF", "NOFF", "CNOFF"},
+			[](const string & file) -> che * { return new che_off(file); },
+			che_off::write_file
+			},
+		{	"obj", {"obj"}, {},
+			[](const string & file) -> che * { return new che_obj(file); },
+			che_obj::write_file
+			},
+		{	"ply", {"ply"}, {"ply"},
+			[](const string & file) -> che * { return new che_ply(file); },
+			che_ply::write_file
+			},
+		{	"che", {"che"}, {"GPROSHAN"},
+			[](const string & file) -> che * { return new che_bin(file); },
+			che_bin::write_file
+			},
+		{	"gpz", {"gpz"}, {string("GPMESHZ", 8)},
+			[](const string & file) -> che * { return new che_gpz(file); },
+			[](const che * mesh, const string & file) { return che_gpz::write_file(mesh, file); }
+			},
+		{	"img", {"jpg", "jpeg", "png", "bmp", "ppm", "pgm", "tif", "tiff"}, {"\x89PNG", "\xFF\xD8\xFF", "BM"},
+			[](const string & file) -> che * { return new che_img(file); },
+			nullptr
+			}
+		};
+
+	return formats;
+}
+
+void register_format(const che_format_t & format)
+{
+	vector<che_format_t> & formats = registry();
+
+	for(che_format_t & f: formats)
+		if(f.name == format.name)
+		{
+			f = format;
+			return;
+		}
+
+	formats.push_back(format);
+}
+
+const vector<che_format_t> & formats()
+{
+	return registry();
+}
+
+const che_format_t * find_format(const string & file)
+{
+	char prefix[16] = {};
+	ifstream is(file, ios::binary);
+	is.read(prefix, sizeof(prefix));
+	const size_t n_read = is.gcount();
+
+	for(const che_format_t & f: formats())
+	for(const string & magic: f.magics)
+		if(magic.size() <= n_read && !magic.compare(0, magic.size(), prefix, magic.size()))
+			return &f;
+
+	const size_t pos = file.rfind('.');
+	if(pos == string::npos) return nullptr;
+
+	string extension = file.substr(pos + 1);
+	transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return tolower(c); });
+
+	for(const che_format_t & f: formats())
+		if(find(f.extensions.begin(), f.extensions.end(), extension) != f.extensions.end())
+			return &f;
+
+	return nullptr;
+}
+
+const che_format_t * format_by_name(const string & name)
+{
+	for(const che_format_t & f: formats())
+		if(f.name == name) return &f;
+
+	return nullptr;
+}
+
+che * load_mesh(const string & file)
+{
+	const che_format_t * format = find_format(file);
+	if(!format)
+	{
+		gproshan_error(unknown mesh format);
+		gproshan_error_var(file);
+		return nullptr;
+	}
+
+	return format->read(file);
+}
+
+vector<che *> load_meshes(const vector<string> & files, size_t max_threads)
+{
+	vector<che *> meshes(files.size(), nullptr);
+
+	const size_t n_cores = omp_get_max_threads();
+	if(!max_threads) max_threads = n_cores;
+
+	const size_t n_threads = min(max_threads, files.size());
+	if(n_threads < 2)
+	{
+		for(index_t i = 0; i < files.size(); i++)
+			meshes[i] = load_mesh(files[i]);
+
+		return meshes;
+	}
+
+	// the parsers of the files are parallel too, they share the cores
+	const int n_inner = max<size_t>(1, n_cores / n_threads);
+
+	atomic<size_t> next(0);
+	vector<thread> threads;
+
+	for(index_t t = 0; t < n_threads; t++)
+		threads.emplace_back([&]()
+		{
+			omp_set_num_threads(n_inner);
+
+			for(size_t i; (i = next++) < files.size(); )
+				meshes[i] = load_mesh(files[i]);
+		});
+
+	for(thread & t: threads)
+		t.join();
+
+	return meshes;
+}
+
+bool write_mesh(const che * mesh, const string & file, const string & format)
+{
+	const che_format_t * f = format_by_name(format);
+	if(!f || !f->write)
+	{
+		gproshan_error_var(format);
+		return false;
+	}
+
+	if(!f->write(mesh, file))
+	{
+		gproshan_error_var(file);
+		return false;
+	}
+
+	return true;
+}
+
+
+} // namespace gproshan
+
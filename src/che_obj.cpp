@@ -1,9 +1,18 @@
 #include "che_obj.h"
 
+#include "file_writer.h"
+#include "text_parser.h"
+
 #include <fstream>
 #include <vector>
+#include <array>
 #include <cstring>
-#include <cassert>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <omp.h>
 
 using namespace std;
 
@@ -12,94 +21,283 @@ using namespace std;
 namespace gproshan {
 
 
-che_obj::che_obj(const string & file)
+che_obj::che_obj(const string & file, const bool & attributes_): attributes(attributes_)
 {
 	init(file);
 }
 
-che_obj::che_obj(const che_obj & mesh): che(mesh)
+che_obj::che_obj(const che_obj & mesh): che(mesh), attributes(mesh.attributes), normals_(mesh.normals_), texcoords_(mesh.texcoords_)
+{
+}
+
+const vector<vertex> & che_obj::normals() const
+{
+	return normals_;
+}
+
+const vector<vertex> & che_obj::texcoords() const
+{
+	return texcoords_;
+}
+
+enum obj_line_t { OBJ_NONE, OBJ_V, OBJ_VT, OBJ_VN, OBJ_F };
+
+// key of the line at p, p is moved after the key
+static inline obj_line_t obj_line(const char *& p, const char * end)
 {
+	p = skip_blanks(p, end);
+
+	auto key = [&](const char * k, const size_t & n) -> bool
+	{
+		if(size_t(end - p) <= n || memcmp(p, k, n) || (p[n] != ' ' && p[n] != '\t')) return false;
+		p += n;
+		return true;
+	};
+
+	if(key("v", 1)) return OBJ_V;
+	if(key("vt", 2)) return OBJ_VT;
+	if(key("vn", 2)) return OBJ_VN;
+	if(key("f", 1)) return OBJ_F;
+	return OBJ_NONE;
 }
 
+// next vertex reference v[/vt][/vn] of a face line, the indexes are 1-based or negative (relative to the
+// n elements defined before the line), they are returned 0-based, NIL if they are not given or invalid
+// (0 or a negative index before the first element)
+static inline bool obj_ref(const char *& p, const char * end, const size_t * n, index_t * ref)
+{
+	p = skip_blanks(p, end);
+	if(p == end || *p == '\n' || *p == '#') return false;
+
+	for(index_t i = 0; i < 3; i++)
+	{
+		ref[i] = NIL;
+
+		if(i && (p == end || *p != '/')) continue;
+		if(i) p++;
+
+		long long x = 0;
+		const from_chars_result r = from_chars(p, end, x);
+		if(r.ptr == p) continue;
+
+		p = r.ptr;
+		if(r.ec != errc()) continue;
+
+		if(x > 0 && (unsigned long long) x <= NIL) ref[i] = x - 1;
+		else if(x < 0 && x >= -(long long) n[i]) ref[i] = n[i] + x;
+	}
+
+	// skip an invalid token
+	while(p < end && !isspace(*p)) p++;
+
+	return true;
+}
+
+/// Chunked parallel parser as che_off: the v, vt, vn and f lines of each chunk are counted, and then
+/// the chunks are parsed in parallel knowing the number of elements defined before them (needed by the
+/// negative indexes). The faces of n > 3 vertices are split in n - 2 triangles as in che_off.
+/// If attributes is true, the normals and texture coordinates of the face corners are kept by vertex.
 void che_obj::read_file(const string & file)
 {
-	ifstream is(file);
+	init(0, 0);
 
-	assert(is.good());
-	
-	real_t x, y, z;
-	index_t face[8], i;
+	int fd = open(file.c_str(), O_RDONLY);
+	if(fd < 0)
+	{
+		gproshan_error_var(file);
+		return;
+	}
 
-	vector<vertex> vertices;
-	vector<index_t> faces;
+	struct stat st;
+	fstat(fd, &st);
 
-	char line[128];
-	string key;
+	const size_t size = st.st_size;
+	char * data = size ? (char *) mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : (char *) MAP_FAILED;
+	close(fd);
 
-	while(is.getline(line, sizeof(line)))
+	if(data == MAP_FAILED)
 	{
-		stringstream ss(line);
-
-		ss >> key;
-		if(key == "") continue;
-
-		if(key == "v")
-		{
-			ss >> x >> y >> z;
-			vertices.push_back({x, y, z});
-		}
-
-		if(key == "f")
-		{
-			for(i = 0; ss >> face[i]; i++)
-				ss.ignore(256, ' ');
-			
-			if(i == che::P) // che::P = 3, triangular mesh
+		gproshan_error_var(file);
+		return;
+	}
+
+	madvise(data, size, MADV_WILLNEED);
+
+	const char * end = data + size;
+
+	const vector<const char *> chunk = text_chunks(data, end, omp_get_max_threads() << 3);
+	const size_t n_chunks = chunk.size() - 1;
+
+	// elements defined before each chunk: v, vt, vn, triangles
+	vector<array<size_t, 4> > count(n_chunks + 1, {0, 0, 0, 0});
+
+	#pragma omp parallel for
+	for(index_t c = 0; c < n_chunks; c++)
+	{
+		array<size_t, 4> & n = count[c + 1];
+		index_t ref[3];
+
+		for(const char * p = chunk[c]; p < chunk[c + 1]; p = next_line(p, end))
+			switch(obj_line(p, end))
 			{
-				faces.push_back(face[0] - 1);	
-				faces.push_back(face[1] - 1);	
-				faces.push_back(face[2] - 1);	
+				case OBJ_V: n[0]++; break;
+				case OBJ_VT: n[1]++; break;
+				case OBJ_VN: n[2]++; break;
+				case OBJ_F:
+				{
+					size_t k = 0;
+					while(obj_ref(p, end, n.data(), ref)) k++;
+					n[3] += k > 2 ? k - 2 : 0;
+					break;
+				}
+				default: break;
 			}
-			else if(i == 4) // quadrangular mesh, split two triangles
+	}
+
+	for(index_t c = 0; c < n_chunks; c++)
+	for(index_t i = 0; i < 4; i++)
+		count[c + 1][i] += count[c][i];
+
+	init(count[n_chunks][0], count[n_chunks][3]);
+
+	vector<vertex> vt, vn;		// vt and vn of the file
+	index_t * he_vt = nullptr;
+	index_t * he_vn = nullptr;
+
+	if(attributes)
+	{
+		vt.resize(count[n_chunks][1]);
+		vn.resize(count[n_chunks][2]);
+		he_vt = new index_t[n_half_edges_];
+		he_vn = new index_t[n_half_edges_];
+	}
+
+	auto parse_vertex = [end](const char * p, vertex & v) -> const char *
+	{
+		return parse(parse(parse(p, end, v.x), end, v.y), end, v.z);
+	};
+
+	bool valid = true;		// all the faces reference a vertex of the file
+
+	#pragma omp parallel for reduction(&&: valid)
+	for(index_t c = 0; c < n_chunks; c++)
+	{
+		array<size_t, 4> n = count[c];
+		index_t ref[3], f[che::P][3];
+
+		for(const char * p = chunk[c]; p < chunk[c + 1]; p = next_line(p, end))
+			switch(obj_line(p, end))
 			{
-				faces.push_back(face[0] - 1);	
-				faces.push_back(face[1] - 1);	
-				faces.push_back(face[3] - 1);
+				case OBJ_V:
+					p = parse_vertex(p, GT[n[0]++]);
+					break;
+				case OBJ_VT:
+					if(attributes) p = parse_vertex(p, vt[n[1]]);
+					n[1]++;
+					break;
+				case OBJ_VN:
+					if(attributes) p = parse_vertex(p, vn[n[2]]);
+					n[2]++;
+					break;
+				case OBJ_F:
+				{
+					index_t he = n[3] * che::P;
+
+					auto add = [&](const index_t * r)
+					{
+						valid = r[0] < n_vertices_ && valid;
+
+						if(attributes)
+						{
+							he_vt[he] = r[1];
+							he_vn[he] = r[2];
+						}
+						VT[he++] = r[0];
+					};
 
-				faces.push_back(face[1] - 1);	
-				faces.push_back(face[2] - 1);	
-				faces.push_back(face[3] - 1);
+					// first triangle f[0], f[1], f[2], next triangles: (f[i], f[0], f[i - 1])
+					index_t k = 0;
+					for(; k < che::P && obj_ref(p, end, n.data(), f[k]); k++);
+					if(k < che::P) break;
+
+					add(f[0]); add(f[1]); add(f[2]);
+					while(obj_ref(p, end, n.data(), ref))
+					{
+						memcpy(f[1], f[2], sizeof(f[2]));
+						memcpy(f[2], ref, sizeof(ref));
+						add(f[2]); add(f[0]); add(f[1]);
+						k++;
+					}
+
+					n[3] += k - 2;
+					break;
+				}
+				default: break;
 			}
-		}
 	}
 
-	is.close();
-	
-	init(vertices.data(), vertices.size(), faces.data(), faces.size() / che::P);
+	munmap(data, size);
+
+	if(!valid)
+	{
+		gproshan_error(the OBJ file has faces with missing or invalid vertex references);
+		gproshan_error_var(file);
+
+		delete [] he_vt;
+		delete [] he_vn;
+		init(0, 0);
+		return;
+	}
+
+	if(!attributes) return;
+
+	// attributes of the first face corner of each vertex
+	auto by_vertex = [this](vector<vertex> & attr, const vector<vertex> & values, const index_t * he_attr)
+	{
+		if(values.empty()) return;
+
+		attr.assign(n_vertices_, vertex());
+		vector<bool> done(n_vertices_, false);
+
+		for(index_t he = 0; he < n_half_edges_; he++)
+			if(he_attr[he] < values.size() && VT[he] < n_vertices_ && !done[VT[he]])
+			{
+				attr[VT[he]] = values[he_attr[he]];
+				done[VT[he]] = true;
+			}
+	};
+
+	by_vertex(normals_, vn, he_vn);
+	by_vertex(texcoords_, vt, he_vt);
+
+	delete [] he_vt;
+	delete [] he_vn;
 }
 
-void che_obj::write_file(const che * mesh, const string & file)
+bool che_obj::write_file(const che * mesh, const string & file)
 {
-	ofstream os(file + ".obj");
+	file_writer os(file + ".obj");
 
 	os << "####\n#\n";
-	os << "# OBJ generated by gproshan 2019" << endl;
-	os << "# vertices: " << mesh->n_vertices() << endl;
-	os << "# faces: " << mesh->n_faces() << endl;
+	os << "# OBJ generated by gproshan 2019\n";
+	os << "# vertices: " << mesh->n_vertices() << '\n';
+	os << "# faces: " << mesh->n_faces() << '\n';
 	os << "#\n####\n";
 
-	for(size_t v = 0; v < mesh->n_vertices(); v++)
-		os << "v " << mesh->gt(v) << endl;
+	os.write_records(mesh->n_vertices(), [&](out_buffer & out, const index_t & v)
+	{
+		out << "v " << mesh->gt(v) << '\n';
+	});
 
-	for(index_t he = 0; he < mesh->n_half_edges(); )
+	os.write_records(mesh->n_faces(), [&](out_buffer & out, const index_t & f)
 	{
-		os << "f";
+		out << 'f';
 		for(index_t i = 0; i < che::P; i++)
-			os << " " << mesh->vt(he++) + 1;
-		os << endl;
-	}
+			out << ' ' << mesh->vt(f * che::P + i) + 1;
+		out << '\n';
+	});
 
-	os.close();
+	return os.flush();
 }
 
 
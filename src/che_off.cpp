@@ -1,9 +1,18 @@
 #include "che_off.h"
 
+#include "file_writer.h"
+#include "text_parser.h"
+
 #include <fstream>
 #include <vector>
+#include <algorithm>
 #include <cstring>
-#include <cassert>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <omp.h>
 
 using namespace std;
 
@@ -25,78 +34,172 @@ che_off::~che_off()
 {
 }
 
+/// The file is memory mapped and the vertices and faces sections are split in chunks at new line
+/// boundaries, which are parsed in parallel: the data lines of each chunk are counted, then the
+/// triangles of the face lines, and finally the vertices and faces are parsed in their final position.
+/// An element by line is expected, the colors and normals of COFF and NOFF files are skipped. The faces
+/// of n > 3 vertices are split in n - 2 triangles, a quad (a, b, c, d) in (a, b, c) and (d, a, c).
 void che_off::read_file(const string & file)
 {
-	string soff;
-	size_t n_v, n_f, v;
+	init(0, 0);
 
-	ifstream is(file);
+	int fd = open(file.c_str(), O_RDONLY);
+	if(fd < 0)
+	{
+		gproshan_error_var(file);
+		return;
+	}
 
-	assert(is.good());
+	struct stat st;
+	fstat(fd, &st);
 
-	is >> soff;
-	is >> n_v >> n_f >> v;
-	init(n_v, n_f);
+	const size_t size = st.st_size;
+	char * data = size ? (char *) mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : (char *) MAP_FAILED;
+	close(fd);
 
-	int r, g, b, a;
-	for(index_t i = 0; i < n_vertices_; i++)
+	if(data == MAP_FAILED)
 	{
-		is >> GT[i];
-		if(soff[0] == 'C') // COFF file, ignore RGBA
-			is >> r >> g >> b >> a;
-		if(soff[0] == 'N') // NOFF file, ignore normals
-			is >> r >> g >> b;
+		gproshan_error_var(file);
+		return;
 	}
 
-	index_t he = 0;
-	for(index_t i = 0; i < n_faces_; i++)
+	madvise(data, size, MADV_WILLNEED);
+
+	const char * end = data + size;
+	const char * p = skip_spaces(data, end);
+
+	// header: [C][N]OFF n_v n_f n_e, the keyword is optional
+	if(p < end && !isdigit(*p))
+		while(p < end && !isspace(*p)) p++;
+
+	size_t n_v = 0, n_f = 0, n_e = 0;
+	p = parse(skip_spaces(p, end), end, n_v);
+	p = parse(skip_spaces(p, end), end, n_f);
+	p = parse(skip_blanks(p, end), end, n_e);
+
+	const char * body = next_line(p, end);
+
+	const vector<const char *> chunk = text_chunks(body, end, omp_get_max_threads() << 3);
+	const size_t n_chunks = chunk.size() - 1;
+
+	// first line and first triangle of each chunk
+	vector<size_t> lines(n_chunks + 1, 0);
+	vector<size_t> trigs(n_chunks + 1, 0);
+
+	#pragma omp parallel for
+	for(index_t c = 0; c < n_chunks; c++)
+		for(const char * q = chunk[c]; q < chunk[c + 1]; q = next_line(q, end))
+			lines[c + 1] += is_data_line(q, end);
+
+	for(index_t c = 0; c < n_chunks; c++)
+		lines[c + 1] += lines[c];
+
+	if(lines[n_chunks] < n_v + n_f)
 	{
-		is >> v;
-		if(!i && v > che::P)
+		gproshan_error(the OFF file has less vertices or faces than its header);
+		gproshan_error_var(file);
+		munmap(data, size);
+		return;
+	}
+
+	#pragma omp parallel for
+	for(index_t c = 0; c < n_chunks; c++)
+	{
+		size_t l = lines[c];
+		for(const char * q = chunk[c]; q < chunk[c + 1] && l < n_v + n_f; q = next_line(q, end))
 		{
-			vertex * tGT = GT; GT = nullptr;
+			if(!is_data_line(q, end)) continue;
 
-			delete_me();
-			init(n_v, n_f * (v - che::P + 1));
+			if(l++ < n_v) continue;
 
-			GT = tGT;
+			size_t n = 0;
+			parse(q, end, n);
+			trigs[c + 1] += n > 2 ? n - 2 : 0;
 		}
+	}
 
-		for(index_t j = 0; j < v; j++)
-			is >> VT[he++];
+	for(index_t c = 0; c < n_chunks; c++)
+		trigs[c + 1] += trigs[c];
 
-		// divide face
-		if(v == 4)
-		{
-			VT[he] = VT[he - v];		he++;
-			VT[he] = VT[he - che::P];	he++;
+	init(n_v, trigs[n_chunks]);
+
+	bool valid = true;		// all the values are present and the indexes are less than n_v
+
+	#pragma omp parallel for reduction(&&: valid)
+	for(index_t c = 0; c < n_chunks; c++)
+	{
+		size_t l = lines[c];
+		index_t he = trigs[c] * che::P;
 
-			i++;
+		for(const char * q = chunk[c]; q < chunk[c + 1] && l < n_v + n_f; q = next_line(q, end))
+		{
+			if(!is_data_line(q, end)) continue;
+
+			if(l < n_v)
+			{
+				vertex & v = GT[l++];
+				valid = parse_next(q, end, v.x) && parse_next(q, end, v.y) && parse_next(q, end, v.z) && valid;
+				continue;
+			}
+
+			l++;
+
+			size_t n = 0;
+			q = parse(q, end, n);
+			if(n < che::P)
+				continue;
+
+			index_t f[che::P] = {};
+			for(index_t i = 0; i < che::P; i++)
+			{
+				valid = parse_next(q, end, f[i]) && f[i] < n_v && valid;
+				VT[he++] = f[i];
+			}
+
+			// next triangles: (f[i], f[0], f[i - 1])
+			for(index_t i = che::P; i < n; i++)
+			{
+				const index_t u = f[2];
+				valid = parse_next(q, end, f[2]) && f[2] < n_v && valid;
+
+				VT[he++] = f[2];
+				VT[he++] = f[0];
+				VT[he++] = u;
+			}
 		}
 	}
 
-	is.close();
+	munmap(data, size);
+
+	if(!valid)
+	{
+		gproshan_error(the OFF file has missing values or invalid vertex indexes);
+		gproshan_error_var(file);
+		init(0, 0);
+	}
 }
 
-void che_off::write_file(const che * mesh, const string & file)
+bool che_off::write_file(const che * mesh, const string & file)
 {
-	ofstream os(file + ".off");
+	file_writer os(file + ".off");
 
-	os << "OFF" << endl;
-	os << mesh->n_vertices() << " " << mesh->n_faces() << " 0" << endl;
+	os << "OFF\n";
+	os << mesh->n_vertices() << ' ' << mesh->n_faces() << " 0\n";
 
-	for(size_t v = 0; v < mesh->n_vertices(); v++)
-		os << mesh->gt(v) << endl;
+	os.write_records(mesh->n_vertices(), [&](out_buffer & out, const index_t & v)
+	{
+		out << mesh->gt(v) << '\n';
+	});
 
-	for(index_t he = 0; he < mesh->n_half_edges(); )
+	os.write_records(mesh->n_faces(), [&](out_buffer & out, const index_t & f)
 	{
-		os << che::P;
+		out << che::P;
 		for(index_t i = 0; i < che::P; i++)
-			os << " " << mesh->vt(he++);
-		os << endl;
-	}
+			out << ' ' << mesh->vt(f * che::P + i);
+		out << '\n';
+	});
 
-	os.close();
+	return os.flush();
 }
 
 
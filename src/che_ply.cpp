@@ -1,11 +1,23 @@
 #include "che_ply.h"
 
+#include "file_writer.h"
+
 #include <fstream>
+#include <sstream>
 #include <vector>
+#include <algorithm>
 #include <cstring>
-#include <cassert>
+#include <cstdint>
+#include <cctype>
+#include <cmath>
+#include <charconv>
 #include <map>
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 using namespace std;
 
 
@@ -13,175 +25,572 @@ using namespace std;
 namespace gproshan {
 
 
-che_ply::che_ply(const string & file)
+struct ply_type_t
+{
+	size_t size = 0;
+	char kind = 0;		///< 'i' signed, 'u' unsigned, 'f' floating point
+};
+
+struct ply_property_t
+{
+	string name;
+	ply_type_t type;
+	ply_type_t count_type;		///< type of the number of items, only for lists
+	bool list = false;
+};
+
+struct ply_element_t
+{
+	string name;
+	size_t n = 0;
+	vector<ply_property_t> properties;
+
+	/// bytes of a binary record, 0 if it has lists (variable size)
+	size_t stride() const
+	{
+		size_t s = 0;
+		for(const ply_property_t & p: properties)
+		{
+			if(p.list) return 0;
+			s += p.type.size;
+		}
+		return s;
+	}
+};
+
+static const map<string, ply_type_t> ply_types =	{
+														{"char", {1, 'i'}},		{"int8", {1, 'i'}},
+														{"uchar", {1, 'u'}},	{"uint8", {1, 'u'}},
+														{"short", {2, 'i'}},	{"int16", {2, 'i'}},
+														{"ushort", {2, 'u'}},	{"uint16", {2, 'u'}},
+														{"int", {4, 'i'}},		{"int32", {4, 'i'}},
+														{"uint", {4, 'u'}},		{"uint32", {4, 'u'}},
+														{"float", {4, 'f'}},	{"float32", {4, 'f'}},
+														{"double", {8, 'f'}},	{"float64", {8, 'f'}},
+														{"int64", {8, 'i'}},	{"uint64", {8, 'u'}}
+													};
+
+enum ply_format_t { ASCII, BINARY, BINARY_SWAP };		///< BINARY_SWAP: binary with the other endianness
+
+static const bool big_endian_host = __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__;
+
+template <class T>
+static inline T load(const char * p, const bool & swap)
+{
+	T x;
+	memcpy(&x, p, sizeof(T));
+	if(!swap) return x;
+
+	if constexpr(sizeof(T) == 2) return __builtin_bswap16(x);
+	if constexpr(sizeof(T) == 4) return __builtin_bswap32(x);
+	if constexpr(sizeof(T) == 8) return __builtin_bswap64(x);
+	return x;
+}
+
+template <class F, class U>
+static inline F load_float(const char * p, const bool & swap)
+{
+	U u = load<U>(p, swap);
+	F x;
+	memcpy(&x, &u, sizeof(F));
+	return x;
+}
+
+/// Reads a value of type t at p and advances p, the ascii values are separated by white spaces.
+/// A missing value (truncated file) is NAN and p is moved after the end to be detected by the caller.
+static inline double read_value(const char *& p, const char * end, const ply_type_t & t, const ply_format_t & format)
+{
+	double x = 0;
+
+	if(format == ASCII)
+	{
+		while(p < end && isspace(*p)) p++;
+		if(p < end && *p == '+') p++;
+
+		const from_chars_result r = p < end ? from_chars(p, end, x) : from_chars_result{p, errc::invalid_argument};
+		if(r.ec != errc())
+		{
+			p = end + 1;
+			return NAN;
+		}
+
+		p = r.ptr;
+		return x;
+	}
+
+	const bool swap = format == BINARY_SWAP;
+
+	if(p > end || end - p < (ptrdiff_t) t.size)
+	{
+		p = end + 1;
+		return NAN;
+	}
+
+	switch(t.kind)
+	{
+		case 'i':
+			if(t.size == 1) x = *(const int8_t *) p;
+			if(t.size == 2) x = (int16_t) load<uint16_t>(p, swap);
+			if(t.size == 4) x = (int32_t) load<uint32_t>(p, swap);
+			if(t.size == 8) x = (int64_t) load<uint64_t>(p, swap);
+			break;
+		case 'u':
+			if(t.size == 1) x = *(const uint8_t *) p;
+			if(t.size == 2) x = load<uint16_t>(p, swap);
+			if(t.size == 4) x = load<uint32_t>(p, swap);
+			if(t.size == 8) x = load<uint64_t>(p, swap);
+			break;
+		case 'f':
+			if(t.size == 4) x = load_float<float, uint32_t>(p, swap);
+			if(t.size == 8) x = load_float<double, uint64_t>(p, swap);
+			break;
+	}
+
+	p += t.size;
+	return x;
+}
+
+/// Reads the number of items of a list, a count that does not fit in the rest of the file (each item
+/// has a byte at least) moves p after the end.
+static inline size_t read_count(const char *& p, const char * end, const ply_type_t & t, const ply_format_t & format)
+{
+	const double n = read_value(p, end, t, format);
+	if(p <= end && n >= 0 && n <= end - p && n == floor(n))
+		return n;
+
+	p = end + 1;
+	return 0;
+}
+
+static inline void skip_property(const char *& p, const char * end, const ply_property_t & prop, const ply_format_t & format)
+{
+	if(!prop.list)
+	{
+		if(format == ASCII) read_value(p, end, prop.type, format);
+		else p += prop.type.size;
+		return;
+	}
+
+	size_t n = read_count(p, end, prop.count_type, format);
+	if(format == ASCII)
+		while(n--) read_value(p, end, prop.type, format);
+	else p += n * prop.type.size;
+}
+
+static inline void skip_record(const char *& p, const char * end, const ply_element_t & element, const ply_format_t & format)
+{
+	for(const ply_property_t & prop: element.properties)
+		skip_property(p, end, prop, format);
+}
+
+
+che_ply::che_ply(const string & file, const bool & attributes_): attributes(attributes_)
 {
 	init(file);
 }
 
-che_ply::che_ply(const che_ply & mesh): che(mesh)
+che_ply::che_ply(const che_ply & mesh): che(mesh), attributes(mesh.attributes), normals_(mesh.normals_), colors_(mesh.colors_)
+{
+}
+
+const vector<vertex> & che_ply::normals() const
+{
+	return normals_;
+}
+
+const vector<vertex> & che_ply::colors() const
 {
+	return colors_;
 }
 
+/// The header is parsed in a layout table of the elements and their properties, the file is memory
+/// mapped and the records are read in two passes: the first one finds the offsets of the records of
+/// variable size (ascii records and faces which are not all triangles) and counts the triangles, the
+/// second one reads the vertices and the faces in parallel.
+/// The x, y, z properties can be in any position and of any type. With attributes, the nx, ny, nz and
+/// red, green, blue properties are loaded too (the integer colors are scaled to [0, 1]), the other
+/// properties and elements are skipped. The faces of n > 3 vertices are split in n - 2 triangles as
+/// in che_off, a file with a face index which is not a vertex of the file is rejected.
 void che_ply::read_file(const string & file)
 {
-	map<string, size_t> bytes =	{
-									{"char", 1},
-									{"uchar", 1},
-									{"short", 2},
-									{"ushort", 2},
-									{"int", 4},
-									{"uint", 4},
-									{"float", 4},
-									{"float32", 4},
-									{"float64", 8},
-									{"double", 8}
-								};
-
-	size_t n_v = 0, n_f = 0, b;
-
-	string str, format, element;
-	
-	ifstream is(file);
-	assert(is.good());
-	
-	size_t xyz = 0, vbytes = 0;
-	size_t fn = 0, fbytes = 0;
-
-	while(getline(is, str) && str != "end_header")
-	{
-		stringstream ss(str);
+	init(0, 0);
+
+	int fd = open(file.c_str(), O_RDONLY);
+	if(fd < 0)
+	{
+		gproshan_error_var(file);
+		return;
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) < 0)
+	{
+		close(fd);
+		gproshan_error_var(file);
+		return;
+	}
 
+	const size_t size = st.st_size;
+	char * data = size ? (char *) mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : (char *) MAP_FAILED;
+	close(fd);
+
+	if(data == MAP_FAILED)
+	{
+		gproshan_error_var(file);
+		return;
+	}
+
+	madvise(data, size, MADV_WILLNEED);
+
+	const char * end = data + size;
+	const char * p = data;
+
+	ply_format_t format = ASCII;
+	vector<ply_element_t> elements;
+
+	// header
+	bool header = false;
+	while(p < end && !header)
+	{
+		const char * eol = (const char *) memchr(p, '\n', end - p);
+		if(!eol) eol = end;
+
+		stringstream ss(string(p, eol));
+		p = eol < end ? eol + 1 : end;
+
+		string str;
 		ss >> str;
-		if(str == "element")
-		{
-			ss >> element;
-			if(element == "vertex") ss >> n_v;
-			if(element == "face") ss >> n_f;
-		}
-		
-		if(str == "property" && element == "vertex")
+
+		if(str == "end_header") header = true;
+
+		if(str == "format")
 		{
 			ss >> str;
-			vbytes += b = bytes[str];
+			if(str == "binary_little_endian") format = big_endian_host ? BINARY_SWAP : BINARY;
+			if(str == "binary_big_endian") format = big_endian_host ? BINARY : BINARY_SWAP;
+		}
 
-			ss >> str;
-			if(str == "x" || str == "y" || str == "z")
-				xyz = b;
+		if(str == "element")
+		{
+			elements.emplace_back();
+			ss >> elements.back().name >> elements.back().n;
 		}
-		
-		if(str == "property" && element == "face")
+
+		if(str == "property" && elements.size())
 		{
+			ply_property_t prop;
+
 			ss >> str;
 			if(str == "list")
 			{
-				ss >> str; fn = bytes[str];
-				ss >> str; fbytes = bytes[str];
+				prop.list = true;
+				ss >> str;
+				if(ply_types.count(str)) prop.count_type = ply_types.at(str);
+				ss >> str;
 			}
-		}
+			if(ply_types.count(str)) prop.type = ply_types.at(str);
+			ss >> prop.name;
 
-		if(str == "format") ss >> format;
+			if(!prop.type.size || (prop.list && !prop.count_type.size))
+			{
+				gproshan_error_var(prop.name);
+				header = false;
+				break;
+			}
+
+			elements.back().properties.push_back(prop);
+		}
 	}
-	
-	init(n_v, n_f);
-	
-	if(format == "ascii")
+
+	const ply_element_t * vertices = nullptr;
+	const ply_element_t * faces = nullptr;
+	index_t xyz[3] = {NIL, NIL, NIL};
+	index_t nxyz[3] = {NIL, NIL, NIL};
+	index_t rgb[3] = {NIL, NIL, NIL};
+	index_t vertex_indices = NIL;
+
+	for(const ply_element_t & e: elements)
 	{
-		for(index_t v = 0; v < n_vertices_; v++)
+		if(e.name == "vertex")
 		{
-			getline(is, str);
-			stringstream ss(str);
-		
-			ss >> GT[v];
+			vertices = &e;
+			for(index_t i = 0; i < e.properties.size(); i++)
+			{
+				if(e.properties[i].name == "x") xyz[0] = i;
+				if(e.properties[i].name == "y") xyz[1] = i;
+				if(e.properties[i].name == "z") xyz[2] = i;
+				if(e.properties[i].name == "nx") nxyz[0] = i;
+				if(e.properties[i].name == "ny") nxyz[1] = i;
+				if(e.properties[i].name == "nz") nxyz[2] = i;
+				if(e.properties[i].name == "red") rgb[0] = i;
+				if(e.properties[i].name == "green") rgb[1] = i;
+				if(e.properties[i].name == "blue") rgb[2] = i;
+			}
 		}
-		
-		index_t p, he = 0;
-		while(n_f--)
+
+		if(e.name == "face")
 		{
-			getline(is, str);
-			stringstream ss(str);
-			
-			ss >> p;
-			while(p--)
-				ss >> VT[he++];
+			faces = &e;
+			for(index_t i = 0; i < e.properties.size(); i++)
+				if(e.properties[i].list && (vertex_indices == NIL || e.properties[i].name == "vertex_indices" || e.properties[i].name == "vertex_index"))
+					vertex_indices = i;
 		}
 	}
-	else // binary_little_endian
+
+	if(!header || !vertices || xyz[0] == NIL || xyz[1] == NIL || xyz[2] == NIL || (faces && vertex_indices == NIL))
+	{
+		gproshan_error(unsupported PLY header);
+		gproshan_error_var(file);
+		munmap(data, size);
+		return;
+	}
+
+	const size_t n_v = vertices->n;
+	const size_t n_f = faces ? faces->n : 0;
+
+	// first pass: records offsets, the fixed size records are at start + i * stride
+	const char * v_start = nullptr;
+	const char * f_start = nullptr;
+	size_t v_stride = 0, f_stride = 0;
+	vector<size_t> v_offset, f_offset;
+	vector<index_t> f_trigs;			// first triangle of each face
+
+	for(const ply_element_t & e: elements)
 	{
-		char vbuffer[vbytes];
-		for(index_t v = 0; v < n_vertices_; v++)
+		const bool is_vertex = &e == vertices;
+		const bool is_face = &e == faces;
+
+		const size_t stride = format == ASCII ? 0 : e.stride();
+		if(stride)
+		{
+			if(p > end || e.n > size_t(end - p) / stride)
+			{
+				p = end + 1;
+				break;
+			}
+
+			if(is_vertex)
+			{
+				v_start = p;
+				v_stride = stride;
+			}
+			p += e.n * stride;
+			continue;
+		}
+
+		// binary faces, all triangles: records of the same size
+		if(is_face && format != ASCII)
 		{
-			is.read(vbuffer, vbytes);
+			size_t list_offset = 0, fixed = 0;
+			bool fixed_size = true;
+			for(index_t i = 0; i < e.properties.size(); i++)
+			{
+				const ply_property_t & prop = e.properties[i];
+				if(i == vertex_indices) list_offset = fixed;
+				else if(prop.list) fixed_size = false;
+				fixed += prop.list ? prop.count_type.size + che::P * prop.type.size : prop.type.size;
+			}
 
-			if(xyz == sizeof(real_t))
-				memcpy(&GT[v], vbuffer, 3 * sizeof(real_t));
-			else
+			if(fixed_size && p <= end && e.n <= size_t(end - p) / fixed)
 			{
-				if(xyz == 4)
+				const ply_type_t & count_type = e.properties[vertex_indices].count_type;
+
+				size_t n_trigs = 0;
+
+				#pragma omp parallel for reduction(+: n_trigs)
+				for(index_t f = 0; f < e.n; f++)
 				{
-					float * X = (float *) vbuffer;
-					for(index_t i = 0; i < 3; i++)
-						GT[v][i] = X[i];
+					const char * q = p + f * fixed + list_offset;
+					n_trigs += read_value(q, end, count_type, format) == che::P;
 				}
-				else
+
+				if(n_trigs == e.n)
 				{
-					double * X = (double *) vbuffer;
-					for(index_t i = 0; i < 3; i++)
-						GT[v][i] = (real_t) X[i];
+					f_start = p;
+					f_stride = fixed;
+					p += e.n * fixed;
+					continue;
 				}
 			}
 		}
 
-		//char fbuffer[fbytes];	// preparing for a hexagon
-		index_t p, he = 0;
-		while(n_f--)
+		// each record has a byte at least
+		if(p > end || e.n > size_t(end - p))
+		{
+			p = end + 1;
+			break;
+		}
+
+		if(is_vertex) v_offset.resize(e.n);
+		if(is_face) f_offset.resize(e.n), f_trigs.resize(e.n + 1);
+
+		for(index_t i = 0; i < e.n; i++)
+		{
+			if(p >= end)
+			{
+				p = end + 1;
+				break;
+			}
+
+			if(is_vertex) v_offset[i] = p - data;
+			if(is_face)
+			{
+				f_offset[i] = p - data;
+
+				const char * q = p;
+				for(index_t j = 0; j < vertex_indices; j++)
+					skip_property(q, end, e.properties[j], format);
+
+				const size_t n = read_count(q, end, e.properties[vertex_indices].count_type, format);
+				f_trigs[i + 1] = f_trigs[i] + (n > 2 ? n - 2 : 0);
+			}
+
+			skip_record(p, end, e, format);
+		}
+	}
+
+	if(p > end)
+	{
+		gproshan_error(the PLY file is truncated);
+		gproshan_error_var(file);
+		munmap(data, size);
+		return;
+	}
+
+	init(n_v, f_stride || !faces ? n_f : f_trigs.back());
+
+	const bool load_normals = attributes && nxyz[0] != NIL && nxyz[1] != NIL && nxyz[2] != NIL;
+	const bool load_colors = attributes && rgb[0] != NIL && rgb[1] != NIL && rgb[2] != NIL;
+
+	if(load_normals) normals_.assign(n_vertices_, vertex());
+	if(load_colors) colors_.assign(n_vertices_, vertex());
+
+	// second pass: vertices and faces
+	#pragma omp parallel for
+	for(index_t v = 0; v < n_vertices_; v++)
+	{
+		const char * q = v_stride ? v_start + v * v_stride : data + v_offset[v];
+
+		for(index_t i = 0; i < vertices->properties.size(); i++)
 		{
-			fn = 0;
-			is.read(vbuffer, fn);
-
-			if(fn == 1) p = *((char *) vbuffer);
-			if(fn == 2) p = *((short *) vbuffer);
-			if(fn == 4) p = *((int *) vbuffer);
-			
-			while(p--)
+			const ply_property_t & prop = vertices->properties[i];
+			if(prop.list)
+			{
+				skip_property(q, end, prop, format);
+				continue;
+			}
+
+			const real_t x = read_value(q, end, prop.type, format);
+			for(index_t k = 0; k < 3; k++)
 			{
-				is.read(vbuffer, fbytes);
-				if(fbytes == 1) VT[he++] = *((char *) vbuffer);
-				if(fbytes == 2) VT[he++] = *((short *) vbuffer);
-				if(fbytes == 4) VT[he++] = *((int *) vbuffer);
+				if(i == xyz[k]) GT[v][k] = x;
+				if(load_normals && i == nxyz[k]) normals_[v][k] = x;
+				if(load_colors && i == rgb[k]) colors_[v][k] = prop.type.kind == 'f' ? x : x / (exp2(8 * prop.type.size) - 1);
 			}
 		}
 	}
 
-	is.close();
+	bool valid = true;		// all the face indexes are vertices of the file
+
+	#pragma omp parallel for reduction(&&: valid)
+	for(index_t f = 0; f < n_f; f++)
+	{
+		const char * q = f_stride ? f_start + f * f_stride : data + f_offset[f];
+		index_t he = (f_stride ? f : f_trigs[f]) * che::P;
+
+		for(index_t j = 0; j < vertex_indices; j++)
+			skip_property(q, end, faces->properties[j], format);
+
+		const ply_property_t & prop = faces->properties[vertex_indices];
+
+		// NAN (missing value) is not valid either
+		auto read_index = [&]() -> index_t
+		{
+			const double x = read_value(q, end, prop.type, format);
+			if(x >= 0 && x < n_v && x == floor(x)) return x;
+
+			valid = false;
+			return 0;
+		};
+
+		const size_t n = read_count(q, end, prop.count_type, format);
+		if(n < che::P) continue;
+
+		index_t t[che::P];
+		for(index_t i = 0; i < che::P; i++)
+			VT[he++] = t[i] = read_index();
+
+		// next triangles: (t[i], t[0], t[i - 1])
+		for(index_t i = che::P; i < n; i++)
+		{
+			const index_t u = t[2];
+			t[2] = read_index();
+
+			VT[he++] = t[2];
+			VT[he++] = t[0];
+			VT[he++] = u;
+		}
+	}
+
+	munmap(data, size);
+
+	if(!valid)
+	{
+		gproshan_error(the PLY file has faces with missing or invalid vertex indexes);
+		gproshan_error_var(file);
+
+		normals_.clear();
+		colors_.clear();
+		init(0, 0);
+	}
 }
 
-void che_ply::write_file(const che * mesh, const string & file)
+/// Binary little endian PLY: the header and the records are written in a buffer and the file is written
+/// with a single write.
+bool che_ply::write_file(const che * mesh, const string & file)
 {
-	ofstream os(file + ".ply");
-	
-	os << "ply" << endl;
-	os << "format ascii 1.0" << endl;
-	os << "comment generated by gproshan 2019" << endl;
-	os << "element vertex " << mesh->n_vertices() << endl;
-	os << "property float x" << endl;
-	os << "property float y" << endl;
-	os << "property float z" << endl;
-	os << "element face " << mesh->n_faces() << endl;
-	os << "property list uchar int vertex_index" << endl;
-	os << "end_header" << endl;
-
-	for(size_t v = 0; v < mesh->n_vertices(); v++)
-		os << mesh->gt(v) << endl;
-
-	for(index_t he = 0; he < mesh->n_half_edges(); )
-	{
-		os << che::P;
+	const size_t n_vertices = mesh->n_vertices();
+	const size_t n_faces = mesh->n_faces();
+
+	const bool index_32 = n_vertices <= UINT32_MAX;
+
+	file_writer os(file + ".ply");
+
+	os << "ply\n";
+	os << "format binary_little_endian 1.0\n";
+	os << "comment generated by gproshan\n";
+	os << "element vertex " << n_vertices << '\n';
+	os << "property " << (sizeof(real_t) == 4 ? "float" : "double") << " x\n";
+	os << "property " << (sizeof(real_t) == 4 ? "float" : "double") << " y\n";
+	os << "property " << (sizeof(real_t) == 4 ? "float" : "double") << " z\n";
+	os << "element face " << n_faces << '\n';
+	os << "property list uchar " << (index_32 ? "uint" : "uint64") << " vertex_indices\n";
+	os << "end_header\n";
+
+	auto store = [](out_buffer & out, auto x)
+	{
+		if(big_endian_host)
+			reverse((char *) &x, (char *) &x + sizeof(x));
+		out.write(&x, sizeof(x));
+	};
+
+	os.write_records(n_vertices, [&](out_buffer & out, const index_t & v)
+	{
+		for(index_t i = 0; i < 3; i++)
+			store(out, mesh->gt(v)[i]);
+	});
+
+	os.write_records(n_faces, [&](out_buffer & out, const index_t & f)
+	{
+		out << char(che::P);
 		for(index_t i = 0; i < che::P; i++)
-			os << " " << mesh->vt(he++);
-		os << endl;
-	}
+		{
+			if(index_32) store(out, uint32_t(mesh->vt(f * che::P + i)));
+			else store(out, uint64_t(mesh->vt(f * che::P + i)));
+		}
+	});
 
-	os.close();
+	return os.flush();
 }
 
 
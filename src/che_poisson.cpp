@@ -52,7 +52,9 @@ void poisson(che * mesh, const size_t & old_n_vertices, index_t k)
 	B.shed_rows(0, old_n_vertices - 1);
 
 	a_mat X;
-	if(spsolve(X, s * L, s * B))
+	if(!spsolve(X, s * L, s * B)) return;
+
+	mesh->edit_vertices();
 	for(index_t v = old_n_vertices; v < mesh->n_vertices(); v++)
 	{
 		mesh->get_vertex(v).x = X(v - old_n_vertices, 0);
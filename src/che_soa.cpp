@@ -0,0 +1,224 @@
+#include "che_soa.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+using namespace std;
+
+
+// AVX-512 and AVX2 versions of the kernels and the scalar fallback, dispatched at run time
+#if defined(__GNUC__) && defined(__x86_64__)
+	#define simd_clones __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+	#define simd_clones
+#endif
+
+
+// geometry processing and shape analysis framework
+namespace gproshan {
+
+
+che_soa::che_soa(const che * mesh_): mesh(mesh_), n_vertices(0), n_padded(0), X(nullptr), Y(nullptr), Z(nullptr)
+{
+	update();
+}
+
+che_soa::~che_soa()
+{
+	delete_me();
+}
+
+void che_soa::update()
+{
+	if(n_vertices != mesh->n_vertices_)
+	{
+		delete_me();
+
+		const size_t width = align / sizeof(real_t);
+
+		n_vertices = mesh->n_vertices_;
+		n_padded = (n_vertices + width - 1) / width * width;
+
+		X = (real_t *) aligned_alloc(align, n_padded * sizeof(real_t));
+		Y = (real_t *) aligned_alloc(align, n_padded * sizeof(real_t));
+		Z = (real_t *) aligned_alloc(align, n_padded * sizeof(real_t));
+
+		memset(X + n_vertices, 0, (n_padded - n_vertices) * sizeof(real_t));
+		memset(Y + n_vertices, 0, (n_padded - n_vertices) * sizeof(real_t));
+		memset(Z + n_vertices, 0, (n_padded - n_vertices) * sizeof(real_t));
+	}
+
+	const vertex * GT = mesh->GT;
+
+	#pragma omp parallel for simd
+	for(index_t v = 0; v < n_vertices; v++)
+	{
+		X[v] = GT[v].x;
+		Y[v] = GT[v].y;
+		Z[v] = GT[v].z;
+	}
+}
+
+const real_t * che_soa::x() const
+{
+	return X;
+}
+
+const real_t * che_soa::y() const
+{
+	return Y;
+}
+
+const real_t * che_soa::z() const
+{
+	return Z;
+}
+
+simd_clones
+void che_soa::area_trigs(area_t * areas) const
+{
+	const index_t * VT = mesh->VT;
+	const size_t n_faces = mesh->n_faces_;
+
+	#pragma omp parallel for simd
+	for(index_t t = 0; t < n_faces; t++)
+	{
+		const index_t a = VT[t * che::P];
+		const index_t b = VT[t * che::P + 1];
+		const index_t c = VT[t * che::P + 2];
+
+		const real_t ux = X[b] - X[a], uy = Y[b] - Y[a], uz = Z[b] - Z[a];
+		const real_t vx = X[c] - X[a], vy = Y[c] - Y[a], vz = Z[c] - Z[a];
+
+		const real_t nx = uy * vz - uz * vy;
+		const real_t ny = uz * vx - ux * vz;
+		const real_t nz = ux * vy - uy * vx;
+
+		areas[t] = sqrt(nx * nx + ny * ny + nz * nz) / 2;
+	}
+}
+
+simd_clones
+void che_soa::normal_trigs(vertex * normals) const
+{
+	const index_t * VT = mesh->VT;
+	const size_t n_faces = mesh->n_faces_;
+
+	#pragma omp parallel for simd
+	for(index_t t = 0; t < n_faces; t++)
+	{
+		const index_t a = VT[t * che::P];
+		const index_t b = VT[t * che::P + 1];
+		const index_t c = VT[t * che::P + 2];
+
+		const real_t ux = X[b] - X[a], uy = Y[b] - Y[a], uz = Z[b] - Z[a];
+		const real_t vx = X[c] - X[a], vy = Y[c] - Y[a], vz = Z[c] - Z[a];
+
+		const real_t nx = uy * vz - uz * vy;
+		const real_t ny = uz * vx - ux * vz;
+		const real_t nz = ux * vy - uy * vx;
+		const real_t n = sqrt(nx * nx + ny * ny + nz * nz);
+
+		normals[t].x = nx / n;
+		normals[t].y = ny / n;
+		normals[t].z = nz / n;
+	}
+}
+
+simd_clones
+void che_soa::cotans(real_t * cot) const
+{
+	const index_t * VT = mesh->VT;
+	const size_t n_faces = mesh->n_faces_;
+
+	#pragma omp parallel for simd
+	for(index_t t = 0; t < n_faces; t++)
+	{
+		const index_t a = VT[t * che::P];
+		const index_t b = VT[t * che::P + 1];
+		const index_t c = VT[t * che::P + 2];
+
+		// edges ab, bc, ca
+		const real_t abx = X[b] - X[a], aby = Y[b] - Y[a], abz = Z[b] - Z[a];
+		const real_t bcx = X[c] - X[b], bcy = Y[c] - Y[b], bcz = Z[c] - Z[b];
+		const real_t cax = X[a] - X[c], cay = Y[a] - Y[c], caz = Z[a] - Z[c];
+
+		const real_t nx = aby * bcz - abz * bcy;
+		const real_t ny = abz * bcx - abx * bcz;
+		const real_t nz = abx * bcy - aby * bcx;
+		const real_t n = sqrt(nx * nx + ny * ny + nz * nz);		// 2 * area, the same for the three corners
+
+		// cotan(he) is the cotangent of the angle at the vertex opposite to he (VT[prev(he)])
+		cot[t * che::P]		= -(cax * bcx + cay * bcy + caz * bcz) / n;
+		cot[t * che::P + 1]	= -(abx * cax + aby * cay + abz * caz) / n;
+		cot[t * che::P + 2]	= -(bcx * abx + bcy * aby + bcz * abz) / n;
+	}
+}
+
+// https://www.mathworks.com/help/pde/ug/pdetriq.html
+simd_clones
+void che_soa::pdetriqs(real_t * q) const
+{
+	const index_t * VT = mesh->VT;
+	const size_t n_faces = mesh->n_faces_;
+	const real_t k = 2 * sqrt(3);	// 4 * sqrt(3) * area = 2 * sqrt(3) * |cross|
+
+	#pragma omp parallel for simd
+	for(index_t t = 0; t < n_faces; t++)
+	{
+		const index_t a = VT[t * che::P];
+		const index_t b = VT[t * che::P + 1];
+		const index_t c = VT[t * che::P + 2];
+
+		const real_t abx = X[b] - X[a], aby = Y[b] - Y[a], abz = Z[b] - Z[a];
+		const real_t bcx = X[c] - X[b], bcy = Y[c] - Y[b], bcz = Z[c] - Z[b];
+		const real_t cax = X[a] - X[c], cay = Y[a] - Y[c], caz = Z[a] - Z[c];
+
+		const real_t nx = aby * bcz - abz * bcy;
+		const real_t ny = abz * bcx - abx * bcz;
+		const real_t nz = abx * bcy - aby * bcx;
+
+		const real_t h = abx * abx + aby * aby + abz * abz
+						+ bcx * bcx + bcy * bcy + bcz * bcz
+						+ cax * cax + cay * cay + caz * caz;
+
+		q[t] = k * sqrt(nx * nx + ny * ny + nz * nz) / h;
+	}
+}
+
+simd_clones
+real_t che_soa::mean_edge() const
+{
+	const index_t * VT = mesh->VT;
+	const index_t * ET = mesh->ET;
+	const size_t n_edges = mesh->n_edges_;
+
+	real_t m = 0;
+
+	#pragma omp parallel for simd reduction(+: m)
+	for(index_t e = 0; e < n_edges; e++)
+	{
+		const index_t he = ET[e];
+		const index_t a = VT[he];
+		const index_t b = VT[he % che::P == che::P - 1 ? he + 1 - che::P : he + 1];		// next(he) inlined
+
+		const real_t dx = X[b] - X[a], dy = Y[b] - Y[a], dz = Z[b] - Z[a];
+		m += sqrt(dx * dx + dy * dy + dz * dz);
+	}
+
+	return m / n_edges;
+}
+
+void che_soa::delete_me()
+{
+	if(X) free(X);
+	if(Y) free(Y);
+	if(Z) free(Z);
+
+	X = Y = Z = nullptr;
+}
+
+
+} // namespace gproshan
+
@@ -0,0 +1,612 @@
+#include "che_stream.h"
+
+#include "che_bin.h"
+#include "che_soa.h"
+
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <cassert>
+#include <cmath>
+
+#include <sys/stat.h>
+
+using namespace std;
+
+
+// geometry processing and shape analysis framework
+namespace gproshan {
+
+
+static const char che_stream_magic[8] = {'G', 'P', 'S', 'T', 'R', 'E', 'A', 'M'};
+
+typedef Eigen::Triplet<sp_mat_e::Scalar, sp_mat_e::StorageIndex> triplet_t;
+
+
+che_stream::block_t::block_t(const string & file)
+{
+	mesh = new che_bin(file + ".che");
+	map = new index_t[mesh->n_vertices()];
+
+	uint64_t n = 0;
+	ifstream is(file + ".map", ios::binary);
+	is.read((char *) &n, sizeof(uint64_t));
+	is.read((char *) map, mesh->n_vertices() * sizeof(index_t));
+
+	loaded = is.good() && n > 0 && n <= mesh->n_vertices();
+	n_owned = loaded ? n : 0;
+}
+
+che_stream::block_t::~block_t()
+{
+	delete mesh;
+	delete [] map;
+}
+
+che_stream::che_stream(const string & path_, const size_t & cache_size_): path(path_), n_vertices_(0), n_faces_(0), n_blocks_(0), owner(nullptr), local(nullptr), cache_size(max(cache_size_, size_t(1)))
+{
+	header_t header;
+	if(!read_header(header, path)) return;
+
+	n_vertices_	= header.n_vertices;
+	n_faces_	= header.n_faces;
+	n_blocks_	= header.n_blocks;
+
+	owner = new index_t[n_vertices_];
+	local = new index_t[n_vertices_];
+
+	ifstream is(path + "/index", ios::binary);
+	is.seekg(sizeof(header_t));
+	is.read((char *) owner, n_vertices_ * sizeof(index_t));
+	is.read((char *) local, n_vertices_ * sizeof(index_t));
+
+	// the blocks and the local indexes are checked against each block when it is loaded (valid_block)
+	bool valid = is.good() && n_blocks_ <= n_vertices_;
+	if(valid) n_owned.assign(n_blocks_, 0);
+	for(index_t v = 0; valid && v < n_vertices_; v++)
+		if((valid = owner[v] < n_blocks_)) n_owned[owner[v]]++;
+
+	for(index_t v = 0; valid && v < n_vertices_; v++)
+		valid = local[v] < n_owned[owner[v]];
+
+	if(!valid)
+	{
+		gproshan_error(corrupt che_stream index);
+		gproshan_error_var(path);
+
+		delete [] owner;
+		delete [] local;
+		owner = local = nullptr;
+		n_owned.clear();
+		n_vertices_ = n_faces_ = n_blocks_ = 0;
+	}
+
+	cache.resize(n_blocks_);
+	lru_pos.resize(n_blocks_);
+}
+
+che_stream::~che_stream()
+{
+	delete [] owner;
+	delete [] local;
+}
+
+/// The block is loaded if it is not cached, evicting the least recently used block when the cache is full.
+/// An evicted block is released by its last user, so the returned block is valid while it is held.
+/// A corrupt block is not cached, nullptr is returned.
+shared_ptr<che_stream::block_t> che_stream::block(const index_t & b)
+{
+	assert(b < n_blocks_);
+
+	shared_ptr<block_t> blk;
+
+	#pragma omp critical (che_stream_cache)
+	{
+		if(!cache[b])
+		{
+			shared_ptr<block_t> loaded = make_shared<block_t>(path + '/' + to_string(b));
+
+			if(valid_block(*loaded, b))
+			{
+				if(lru.size() == cache_size)
+				{
+					cache[lru.back()].reset();
+					lru.pop_back();
+				}
+
+				cache[b] = loaded;
+				lru.push_front(b);
+				lru_pos[b] = lru.begin();
+			}
+			else
+			{
+				gproshan_error(corrupt che_stream block);
+				gproshan_error_var(path + '/' + to_string(b));
+			}
+		}
+		else
+		{
+			lru.splice(lru.begin(), lru, lru_pos[b]);
+			lru_pos[b] = lru.begin();
+		}
+
+		blk = cache[b];
+	}
+
+	return blk;
+}
+
+/// The map must reference global vertices and the owned local vertices must be the vertices of the
+/// index owned by b, in their local order: the global arrays are indexed with map without checks.
+bool che_stream::valid_block(const block_t & blk, const index_t & b) const
+{
+	if(!blk.loaded || blk.n_owned != n_owned[b]) return false;
+
+	bool valid = true;
+
+	#pragma omp parallel for reduction(&&: valid)
+	for(index_t v = 0; v < blk.mesh->n_vertices(); v++)
+	{
+		const index_t & u = blk.map[v];
+		valid = valid && u < n_vertices_ && (v >= blk.n_owned || (owner[u] == b && local[u] == v));
+	}
+
+	return valid;
+}
+
+const index_t & che_stream::owner_v(const index_t & v) const
+{
+	assert(v < n_vertices_);
+	return owner[v];
+}
+
+const index_t & che_stream::local_v(const index_t & v) const
+{
+	assert(v < n_vertices_);
+	return local[v];
+}
+
+const size_t & che_stream::n_vertices() const
+{
+	return n_vertices_;
+}
+
+const size_t & che_stream::n_faces() const
+{
+	return n_faces_;
+}
+
+const size_t & che_stream::n_blocks() const
+{
+	return n_blocks_;
+}
+
+/// Each edge is counted in the block owning its minimum global vertex.
+real_t che_stream::mean_edge()
+{
+	real_t sum = 0;
+	size_t n_edges = 0;
+
+	for(index_t b = 0; b < n_blocks_; b++)
+	{
+		shared_ptr<block_t> blk = block(b);
+		if(!blk) return NAN;
+
+		const che * mesh = blk->mesh;
+		const index_t * map = blk->map;
+
+		#pragma omp parallel for reduction(+: sum, n_edges)
+		for(index_t e = 0; e < mesh->n_edges(); e++)
+		{
+			const index_t & he = mesh->et(e);
+			if(owner[min(map[mesh->vt(he)], map[mesh->vt(next(he))])] == b)
+			{
+				sum += *(mesh->gt_vt(next(he)) - mesh->gt_vt(he));
+				n_edges++;
+			}
+		}
+	}
+
+	return sum / n_edges;
+}
+
+/// Each face is counted in the block owning its minimum global vertex.
+area_t che_stream::area_surface()
+{
+	area_t area = 0;
+
+	for(index_t b = 0; b < n_blocks_; b++)
+	{
+		shared_ptr<block_t> blk = block(b);
+		if(!blk) return NAN;
+
+		const che * mesh = blk->mesh;
+		const index_t * map = blk->map;
+
+		#pragma omp parallel for reduction(+: area)
+		for(index_t t = 0; t < mesh->n_faces(); t++)
+		{
+			index_t v = NIL;
+			for(index_t he = t * che::P; he < (t + 1) * che::P; he++)
+				v = min(v, map[mesh->vt(he)]);
+
+			if(owner[v] == b)
+				area += mesh->area_trig(t);
+		}
+	}
+
+	return area;
+}
+
+void che_stream::normals(vertex * n)
+{
+	for(index_t b = 0; b < n_blocks_; b++)
+	{
+		shared_ptr<block_t> blk = block(b);
+		if(!blk) return;
+
+		#pragma omp parallel for
+		for(index_t v = 0; v < blk->n_owned; v++)
+			n[blk->map[v]] = blk->mesh->normal(v);
+	}
+}
+
+/// The rows of the owned vertices are assembled by each block, the edges of an owned vertex have all
+/// their faces in the block.
+void che_stream::laplacian(sp_mat_e & L, sp_mat_e & A)
+{
+	vector<triplet_t> tL, tA;
+
+	for(index_t b = 0; b < n_blocks_; b++)
+	{
+		shared_ptr<block_t> blk = block(b);
+		if(!blk)
+		{
+			L.resize(0, 0);
+			A.resize(0, 0);
+			return;
+		}
+
+		che * mesh = blk->mesh;
+		const index_t * map = blk->map;
+		const size_t & n_owned = blk->n_owned;
+
+		real_t * cot = new real_t[mesh->n_half_edges()];
+		area_t * areas = new area_t[mesh->n_faces()];
+
+		che_soa soa(mesh);
+		soa.cotans(cot);
+		soa.area_trigs(areas);
+
+		#pragma omp parallel
+		{
+			vector<triplet_t> t;
+
+			#pragma omp for nowait
+			for(index_t e = 0; e < mesh->n_edges(); e++)
+			{
+				const index_t & he = mesh->et(e);
+				const index_t u = mesh->vt(he);
+				const index_t v = mesh->vt(next(he));
+
+				if(u >= n_owned && v >= n_owned) continue;
+
+				const real_t s = (cot[he] + (mesh->ot_et(e) != NIL ? cot[mesh->ot_et(e)] : 0)) / 2;
+
+				if(u < n_owned)
+				{
+					t.emplace_back(map[u], map[u], s);
+					t.emplace_back(map[u], map[v], -s);
+				}
+				if(v < n_owned)
+				{
+					t.emplace_back(map[v], map[v], s);
+					t.emplace_back(map[v], map[u], -s);
+				}
+			}
+
+			#pragma omp critical (che_stream_laplacian)
+			tL.insert(tL.end(), t.begin(), t.end());
+		}
+
+		for(index_t v = 0; v < n_owned; v++)
+		{
+			area_t area_star = 0;
+			for_star(he, mesh, v)
+				area_star += areas[trig(he)];
+
+			tA.emplace_back(map[v], map[v], area_star / 3);
+		}
+
+		delete [] cot;
+		delete [] areas;
+	}
+
+	L.resize(n_vertices_, n_vertices_);
+	L.setFromTriplets(tL.begin(), tL.end());
+
+	A.resize(n_vertices_, n_vertices_);
+	A.setFromTriplets(tA.begin(), tA.end());
+}
+
+/// Level synchronous BFS as che::compute_toplesets, the vertices of each level are sorted by block
+/// (sort_by_block) and the rings of each block are expanded in parallel.
+void che_stream::compute_toplesets(index_t * toplesets, index_t * sorted, vector<index_t> & limits, const vector<index_t> & sources)
+{
+	limits.clear();
+	if(!sources.size()) return;
+
+	memset(toplesets, -1, sizeof(index_t) * n_vertices_);
+
+	index_t p = 0;
+	for(const index_t & s: sources)
+		if(toplesets[s] == NIL)
+		{
+			toplesets[s] = 0;
+			sorted[p++] = s;
+		}
+
+	index_t level = 0;
+	index_t begin = 0, end = p;
+
+	limits.push_back(0);
+	while(begin < end)
+	{
+		sort_by_block(sorted + begin, sorted + end);
+
+		for(index_t i = begin, j; i < end; i = j)
+		{
+			const index_t & b = owner[sorted[i]];
+			for(j = i + 1; j < end && owner[sorted[j]] == b; j++);
+
+			shared_ptr<block_t> blk = block(b);
+			if(!blk)
+			{
+				limits.clear();
+				return;
+			}
+
+			che * mesh = blk->mesh;
+			const index_t * map = blk->map;
+
+			#pragma omp parallel for
+			for(index_t k = i; k < j; k++)
+			for(const index_t & u: mesh->ring(local[sorted[k]]))
+			{
+				index_t nil = NIL;
+				if(__atomic_compare_exchange_n(toplesets + map[u], &nil, level + 1, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				{
+					index_t q;
+					#pragma omp atomic capture
+					q = p++;
+
+					sorted[q] = map[u];
+				}
+			}
+		}
+
+		limits.push_back(end);
+
+		begin = end;
+		end = p;
+		level++;
+	}
+}
+
+/// Sort the vertices by owner block and local index, to load each block once for a set of vertices.
+void che_stream::sort_by_block(index_t * first, index_t * last) const
+{
+	sort(first, last, [this](const index_t & u, const index_t & v)
+	{
+		return owner[u] < owner[v] || (owner[u] == owner[v] && local[u] < local[v]);
+	});
+}
+
+/// The vertices are assigned to the cells of a regular k x k x k grid of the bounding box, k is chosen
+/// to have about block_size vertices by cell if they were uniformly distributed, the empty cells are
+/// skipped. The mesh is only read, it can be a memory mapped che_bin larger than the memory.
+bool che_stream::write_file(const che * mesh, const string & path, const size_t & block_size)
+{
+	const size_t n_vertices = mesh->n_vertices();
+	const size_t n_faces = mesh->n_faces();
+
+	mkdir(path.c_str(), 0755);
+
+	vertex pmin, pmax;
+	if(n_vertices) pmin = pmax = mesh->gt(0);
+	for(index_t v = 1; v < n_vertices; v++)
+	for(index_t i = 0; i < 3; i++)
+	{
+		pmin[i] = min(pmin[i], mesh->gt(v)[i]);
+		pmax[i] = max(pmax[i], mesh->gt(v)[i]);
+	}
+
+	const size_t k = max(size_t(ceil(cbrt(double(n_vertices) / max(block_size, size_t(1))))), size_t(1));
+
+	index_t * owner = new index_t[n_vertices];
+	index_t * local = new index_t[n_vertices];
+
+	#pragma omp parallel for
+	for(index_t v = 0; v < n_vertices; v++)
+	{
+		index_t cell = 0;
+		for(index_t i = 3; i-- > 0;)
+		{
+			real_t d = pmax[i] > pmin[i] ? (mesh->gt(v)[i] - pmin[i]) / (pmax[i] - pmin[i]) : 0;
+			cell = cell * k + min(index_t(d * k), index_t(k - 1));
+		}
+		owner[v] = cell;
+	}
+
+	// cells -> blocks, the owned vertices of each block sorted by index in sorted[offset[b], offset[b + 1])
+	vector<index_t> cell_block(k * k * k, 0);
+	for(index_t v = 0; v < n_vertices; v++)
+		cell_block[owner[v]]++;
+
+	vector<index_t> offset = {0};
+	for(index_t & c: cell_block)
+		if(c)
+		{
+			offset.push_back(offset.back() + c);
+			c = offset.size() - 2;
+		}
+
+	const size_t n_blocks = offset.size() - 1;
+
+	index_t * sorted = new index_t[n_vertices];
+	vector<index_t> count(offset.begin(), offset.end() - 1);
+	for(index_t v = 0; v < n_vertices; v++)
+	{
+		index_t & b = owner[v] = cell_block[owner[v]];
+		local[v] = count[b] - offset[b];
+		sorted[count[b]++] = v;
+	}
+
+	// a face is stored in the blocks owning its vertices, in faces[foffset[b], foffset[b + 1]) in the global
+	// order, so that the stars of the owned vertices start at the same he (EVT) that in the mesh
+	auto face_blocks = [&](const index_t & t, index_t * fb) -> index_t
+	{
+		index_t n = 0;
+		for(index_t he = t * che::P; he < (t + 1) * che::P; he++)
+		{
+			const index_t & b = owner[mesh->vt(he)];
+			if(find(fb, fb + n, b) == fb + n) fb[n++] = b;
+		}
+		return n;
+	};
+
+	vector<index_t> foffset(n_blocks + 1, 0);
+	for(index_t t = 0; t < n_faces; t++)
+	{
+		index_t fb[che::P];
+		for(index_t i = 0, n = face_blocks(t, fb); i < n; i++)
+			foffset[fb[i] + 1]++;
+	}
+
+	for(index_t b = 0; b < n_blocks; b++)
+		foffset[b + 1] += foffset[b];
+
+	vector<index_t> faces(foffset.back());
+	count.assign(foffset.begin(), foffset.end() - 1);
+	for(index_t t = 0; t < n_faces; t++)
+	{
+		index_t fb[che::P];
+		for(index_t i = 0, n = face_blocks(t, fb); i < n; i++)
+			faces[count[fb[i]]++] = t;
+	}
+
+	index_t * stamp = new index_t[n_vertices];
+	index_t * lid = new index_t[n_vertices];
+
+	memset(stamp, -1, sizeof(index_t) * n_vertices);
+
+	vector<index_t> map;
+	vector<vertex> V;
+	vector<index_t> F;
+
+	bool ok = true;
+	for(index_t b = 0; ok && b < n_blocks; b++)
+	{
+		map.assign(sorted + offset[b], sorted + offset[b + 1]);
+
+		V.clear();
+		for(const index_t & v: map)
+		{
+			stamp[v] = b;
+			lid[v] = local[v];
+			V.push_back(mesh->gt(v));
+		}
+
+		const index_t * bfaces = faces.data() + foffset[b];
+		const size_t n_bfaces = foffset[b + 1] - foffset[b];
+
+		F.resize(n_bfaces * che::P);
+		for(index_t i = 0; i < F.size(); i++)
+		{
+			const index_t & v = mesh->vt(bfaces[i / che::P] * che::P + i % che::P);
+			if(stamp[v] != b)
+			{
+				stamp[v] = b;
+				lid[v] = map.size();
+				map.push_back(v);
+				V.push_back(mesh->gt(v));
+			}
+
+			F[i] = lid[v];
+		}
+
+		const string file = path + '/' + to_string(b);
+
+		che block_mesh(V.data(), V.size(), F.data(), n_bfaces);
+		ok = che_bin::write_file(&block_mesh, file);
+
+		uint64_t n_owned = offset[b + 1] - offset[b];
+		ofstream os(file + ".map", ios::binary);
+		os.write((char *) &n_owned, sizeof(uint64_t));
+		os.write((char *) map.data(), map.size() * sizeof(index_t));
+		os.close();
+
+		ok = ok && !os.fail();
+	}
+
+	header_t header;
+	memcpy(header.magic, che_stream_magic, sizeof(header.magic));
+
+	header.version		= version;
+	header.size_index	= sizeof(index_t);
+	header.n_vertices	= n_vertices;
+	header.n_faces		= n_faces;
+	header.n_blocks		= n_blocks;
+
+	// the index is written last, a directory without it is not read as a che_stream
+	if(ok)
+	{
+		ofstream os(path + "/index", ios::binary);
+		os.write((char *) &header, sizeof(header_t));
+		os.write((char *) owner, n_vertices * sizeof(index_t));
+		os.write((char *) local, n_vertices * sizeof(index_t));
+		os.close();
+
+		ok = !os.fail();
+	}
+
+	if(!ok) gproshan_error_var(path);
+
+	delete [] owner;
+	delete [] local;
+	delete [] sorted;
+	delete [] stamp;
+	delete [] lid;
+
+	return ok;
+}
+
+bool che_stream::read_header(header_t & header, const string & path)
+{
+	ifstream is(path + "/index", ios::binary);
+
+	if(!is.read((char *) &header, sizeof(header_t)) || memcmp(header.magic, che_stream_magic, sizeof(header.magic)))
+	{
+		gproshan_error(not a che_stream directory);
+		return false;
+	}
+
+	if(header.version != version)
+	{
+		gproshan_error_var(header.version);
+		return false;
+	}
+
+	if(header.size_index != sizeof(index_t))
+	{
+		gproshan_error(che_stream written with a different index_t size: check INDEX_64 in config.h);
+		gproshan_error_var(header.size_index);
+		return false;
+	}
+
+	return true;
+}
+
+
+} // namespace gproshan
+
@@ -0,0 +1,145 @@
+#include "che_view.h"
+
+#include <cstring>
+#include <cassert>
+
+using namespace std;
+
+
+// geometry processing and shape analysis framework
+namespace gproshan {
+
+
+che_view::che_view(const che * mesh_): mesh(mesh_), n_mesh_vertices(mesh_->n_vertices()), n_vertices_(0), n_capacity(0), V(nullptr), EVT(nullptr)
+{
+	inv = new index_t[n_mesh_vertices];
+	memset(inv, -1, sizeof(index_t) * n_mesh_vertices);
+}
+
+che_view::che_view(const che * mesh_, const index_t * vertices, const size_t & n): che_view(mesh_)
+{
+	set(vertices, n);
+}
+
+che_view::~che_view()
+{
+	delete [] V;
+	delete [] inv;
+	delete [] EVT;
+}
+
+/// The vertices must be different vertices of the mesh.
+void che_view::set(const index_t * vertices, const size_t & n)
+{
+	#pragma omp parallel for
+	for(index_t v = 0; v < n_vertices_; v++)
+		inv[V[v]] = NIL;
+
+	if(n > n_capacity)
+	{
+		delete [] V;
+		delete [] EVT;
+
+		n_capacity = n;
+		V = new index_t[n_capacity];
+		EVT = new index_t[n_capacity];
+	}
+
+	n_vertices_ = n;
+
+	#pragma omp parallel for
+	for(index_t v = 0; v < n_vertices_; v++)
+	{
+		V[v] = vertices[v];
+		inv[V[v]] = v;
+	}
+
+	// as che::update_evt_ot_et: the border he of v if it is unique, NIL if v has more than one border
+	#pragma omp parallel for
+	for(index_t v = 0; v < n_vertices_; v++)
+	{
+		index_t & e = EVT[v] = NIL;
+		index_t n_border = 0;
+
+		for_star(he, mesh, V[v])
+			if(is_face(trig(he)))
+			{
+				if(e == NIL) e = he;
+				if(ot(he) == NIL)
+				{
+					e = he;
+					n_border++;
+				}
+			}
+
+		if(n_border > 1) e = NIL;
+	}
+}
+
+bool che_view::is_face(const index_t & t) const
+{
+	const index_t he = t * che::P;
+	return inv[mesh->vt(he)] != NIL && inv[mesh->vt(next(he))] != NIL && inv[mesh->vt(prev(he))] != NIL;
+}
+
+bool che_view::is_border_v(const index_t & v) const
+{
+	assert(EVT[v] != NIL);
+	return ot(EVT[v]) == NIL;
+}
+
+index_t che_view::vt(const index_t & he) const
+{
+	return inv[mesh->vt(he)];
+}
+
+/// The he must be in a face of the view, the opposite face shares two vertices with it.
+index_t che_view::ot(const index_t & he) const
+{
+	const index_t & o = mesh->ot(he);
+	return o != NIL && inv[mesh->vt(prev(o))] != NIL ? o : NIL;
+}
+
+const vertex & che_view::gt(const index_t & v) const
+{
+	assert(v < n_vertices_);
+	return mesh->gt(V[v]);
+}
+
+const index_t & che_view::evt(const index_t & v) const
+{
+	assert(v < n_vertices_);
+	return EVT[v];
+}
+
+const index_t & che_view::mesh_v(const index_t & v) const
+{
+	assert(v < n_vertices_);
+	return V[v];
+}
+
+const index_t & che_view::local_v(const index_t & v) const
+{
+	assert(v < n_mesh_vertices);
+	return inv[v];
+}
+
+const size_t & che_view::n_vertices() const
+{
+	return n_vertices_;
+}
+
+const che * che_view::parent() const
+{
+	return mesh;
+}
+
+/// The inverse map is sized to the vertices of the mesh, the other tables are rebuilt by set().
+bool che_view::is_view_of(const che * mesh_) const
+{
+	return mesh == mesh_ && n_mesh_vertices == mesh_->n_vertices();
+}
+
+
+} // namespace gproshan
+
@@ -1,5 +1,7 @@
 #include "decimation.h"
 
+#include "che_soa.h"
+
 using namespace std;
 
 
@@ -99,9 +101,10 @@ void decimation::execute(const vertex *const & normals)
 
 void decimation::compute_quadrics()
 {
-	vertex n;
+	vertex * normals = new vertex[mesh->n_faces()];
+	che_soa(mesh).normal_trigs(normals);
 
-	#pragma omp parallel for private(n)
+	#pragma omp parallel for
 	for(index_t v = 0; v < mesh->n_vertices(); v++)
 	{
 		Q[v].resize(4,4);
@@ -110,7 +113,7 @@ void decimation::compute_quadrics()
 
 		for_star(he, mesh, v)
 		{
-			n = mesh->normal_he(he);
+			const vertex & n = normals[trig(he)];
 			p(0) = n.x;
 			p(1) = n.y;
 			p(2) = n.z;
@@ -119,6 +122,8 @@ void decimation::compute_quadrics()
 			Q[v] += p * p.t();
 		}
 	}
+
+	delete [] normals;
 }
 
 void decimation::order_edges(index_t * const & sort_edges, real_t * const & error_edges)
@@ -1,7 +1,7 @@
 #include "dijkstra.h"
 
-#include <cstring>
 #include <cmath>
+#include <algorithm>
 
 using namespace std;
 
@@ -10,26 +10,33 @@ using namespace std;
 namespace gproshan {
 
 
-dijkstra::dijkstra(che * shape, index_t src)
+dijkstra::dijkstra(che * shape): mesh(shape), n_vertices(shape->n_vertices()), Q(shape->n_vertices())
 {
-	n_vertices = shape->n_vertices();
-	source = src;
-
 	weights = new distance_t[n_vertices];
 	predecessors = new index_t[n_vertices];
-
-	memset(predecessors, 255, sizeof(distance_t)*n_vertices);
+	roots = new index_t[n_vertices];
+	fixed = new bool[n_vertices];
 
 	for(index_t i = 0; i < n_vertices; i++)
+	{
 		weights[i] = INFINITY;
+		predecessors[i] = NIL;
+		roots[i] = NIL;
+		fixed[i] = false;
+	}
+}
 
-	run(shape);
+dijkstra::dijkstra(che * shape, index_t src): dijkstra(shape)
+{
+	run({src});
 }
 
 dijkstra::~dijkstra()
 {
-	if(weights)	delete weights;
-	if(predecessors) delete predecessors;
+	delete [] weights;
+	delete [] predecessors;
+	delete [] roots;
+	delete [] fixed;
 }
 
 distance_t & dijkstra::operator()(index_t i)
@@ -42,65 +49,84 @@ index_t & dijkstra::operator[](index_t i)
 	return predecessors[i];
 }
 
+const index_t & dijkstra::root(const index_t & v) const
+{
+	return roots[v];
+}
+
+const vector<index_t> & dijkstra::sorted() const
+{
+	return settled;
+}
+
 void dijkstra::print(ostream & os)
 {
 	for(index_t i = 0; i < n_vertices; i++)
 		os<<weights[i]<<endl;
 }
 
-void dijkstra::run(che * shape)
+size_t dijkstra::run(const vector<index_t> & sources, const distance_t & radius, const index_t & target)
 {
-	bool * visited = new bool[n_vertices];
-	memset(visited, 0, sizeof(bool)*n_vertices);
+	for(const index_t & v: touched)
+	{
+		weights[v] = INFINITY;
+		predecessors[v] = NIL;
+		roots[v] = NIL;
+		fixed[v] = false;
+	}
 
-	visited[source] = true;
-	weights[source] = 0;
+	touched.clear();
+	settled.clear();
+	Q.clear();
 
-	distance_t min;
-	index_t min_i;
+	for(index_t i = 0; i < sources.size(); i++)
+	{
+		const index_t & s = sources[i];
+		if(weights[s] == 0) continue;
 
-	for(index_t i = 0; i < n_vertices; i++)
+		weights[s] = 0;
+		roots[s] = i;
+		touched.push_back(s);
+		Q.update(s, 0);
+	}
+
+	while(!Q.empty() && Q.top_key() <= radius)
 	{
-		min = INFINITY;
-		min_i = NIL;
+		const index_t u = Q.pop();
+		fixed[u] = true;
+		settled.push_back(u);
+
+		if(u == target) break;
 
-		#pragma	omp parallel for num_threads(8)
-		for(index_t v = 0; v < n_vertices; v++)
+		for(const index_t & v: mesh->ring(u))
 		{
-			distance_t w;
-			index_t nv;
+			const distance_t w = weights[u] + *(mesh->gt(v) - mesh->gt(u));
 
-			if(!visited[v])
+			if(w < weights[v])
 			{
-				link_t link_he;
-				shape->link(link_he, v);
-
-				for(index_t he: link_he)
-				{
-					nv = shape->vt(next(he));
-
-					if(visited[nv])
-					{
-						w = weights[nv] + *(shape->get_vertex(nv) - shape->get_vertex(v));
-
-						if(w < weights[v])
-							weights[v] = w;
-					}
-				}
-
-				#pragma omp critical
-				if(weights[v] < min)
-				{
-					min = weights[v];
-					min_i = v;
-				}
+				if(weights[v] == INFINITY) touched.push_back(v);
+
+				weights[v] = w;
+				predecessors[v] = u;
+				roots[v] = roots[u];
+				Q.update(v, w);
 			}
 		}
-
-		if(min_i != NIL) visited[min_i] = true;
 	}
 
-	delete visited;
+	return settled.size();
+}
+
+vector<index_t> dijkstra::path(const index_t & v) const
+{
+	vector<index_t> p;
+	if(!fixed[v]) return p;
+
+	for(index_t u = v; u != NIL; u = predecessors[u])
+		p.push_back(u);
+
+	reverse(p.begin(), p.end());
+	return p;
 }
 
 
@@ -0,0 +1,165 @@
+#include "file_writer.h"
+
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+
+// geometry processing and shape analysis framework
+namespace gproshan {
+
+
+static const char field_magic[8] = {'G', 'P', 'F', 'I', 'E', 'L', 'D', '\0'};
+static const uint32_t field_version = 1;
+
+
+file_writer::file_writer(const string & file_, const size_t & capacity_): file(file_), os(file, ios::binary), capacity(capacity_)
+{
+	if(!os.is_open()) gproshan_error_var(file);
+	buffer.reserve(capacity + (capacity >> 4));
+}
+
+file_writer::~file_writer()
+{
+	if(buffer.size() && !flush()) gproshan_error_var(file);
+}
+
+bool file_writer::good() const
+{
+	return os.good();
+}
+
+bool file_writer::flush()
+{
+	os.write(buffer.data(), buffer.size());
+	os.flush();
+	buffer.clear();
+
+	return os.good();
+}
+
+void file_writer::commit()
+{
+	if(buffer.size() >= capacity) flush();
+}
+
+
+bool write_file_durable(const string & file, const void * data, const size_t & n)
+{
+	const string tmp = file + ".tmp";
+
+	int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0)
+	{
+		gproshan_error_var(tmp);
+		return false;
+	}
+
+	const char * p = (const char *) data;
+	size_t left = n;
+	while(left)
+	{
+		const ssize_t w = write(fd, p, left);
+		if(w < 0 && errno == EINTR) continue;
+		if(w <= 0) break;
+
+		p += w;
+		left -= w;
+	}
+
+	bool ok = !left && !fsync(fd);
+	ok = !close(fd) && ok;
+	ok = ok && !rename(tmp.c_str(), file.c_str());
+
+	if(!ok)
+	{
+		gproshan_error_var(file);
+		unlink(tmp.c_str());
+		return false;
+	}
+
+	// the new directory entry of the rename
+	const size_t slash = file.rfind('/');
+	const string dir = slash == string::npos ? "." : file.substr(0, slash + 1);
+
+	int dir_fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+	if(dir_fd >= 0)
+	{
+		fsync(dir_fd);
+		close(dir_fd);
+	}
+
+	return true;
+}
+
+bool write_field(const string & file, const real_t * values, const size_t & n_vertices, const size_t & dim, const bool & durable)
+{
+	field_header_t header;
+	memcpy(header.magic, field_magic, sizeof(header.magic));
+	header.version = field_version;
+	header.size_real = sizeof(real_t);
+	header.n_vertices = n_vertices;
+	header.dim = dim;
+
+	if(durable)
+	{
+		out_buffer out;
+		out.reserve(sizeof(field_header_t) + n_vertices * dim * sizeof(real_t));
+		out.write(&header, sizeof(field_header_t));
+		out.write(values, n_vertices * dim * sizeof(real_t));
+
+		return write_file_durable(file, out.data(), out.size());
+	}
+
+	ofstream os(file, ios::binary);
+	os.write((char *) &header, sizeof(field_header_t));
+	os.write((char *) values, n_vertices * dim * sizeof(real_t));
+	os.close();
+
+	if(os.fail())
+	{
+		gproshan_error_var(file);
+		return false;
+	}
+
+	return true;
+}
+
+bool read_field(const string & file, vector<real_t> & values, size_t & dim)
+{
+	ifstream is(file, ios::binary);
+
+	field_header_t header;
+	if(!is.read((char *) &header, sizeof(field_header_t)) || memcmp(header.magic, field_magic, sizeof(header.magic)))
+	{
+		gproshan_error_var(file);
+		return false;
+	}
+
+	if(header.version != field_version || header.size_real != sizeof(real_t))
+	{
+		gproshan_error(field written with a different version or real_t size: check SINGLE_P in config.h);
+		gproshan_error_var(header.size_real);
+		return false;
+	}
+
+	dim = header.dim;
+	values.resize(header.n_vertices * dim);
+
+	if(!is.read((char *) values.data(), values.size() * sizeof(real_t)))
+	{
+		gproshan_error(truncated field file);
+		gproshan_error_var(file);
+		return false;
+	}
+
+	return true;
+}
+
+
+} // namespace gproshan
+
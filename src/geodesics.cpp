@@ -2,8 +2,8 @@
 #include "geodesics_ptp.h"
 
 #include "heat_flow.h"
+#include "heap.h"
 
-#include <queue>
 #include <cassert>
 
 using namespace std;
@@ -120,9 +120,7 @@ void geodesics::run_fastmarching(che * mesh, const vector<index_t> & sources, co
 
 	size_t green_count = n_iter ? n_iter : n_vertices;
 
-	priority_queue<pair<distance_t, size_t>,
-			vector<pair<distance_t, size_t> >,
-			greater<pair<distance_t, size_t> > > Q;
+	indexed_heap<distance_t> Q(n_vertices);		// RED vertices, each once with its current distance
 
 	distance_t dv, dp;
 	index_t dir; // dir propagation
@@ -137,27 +135,19 @@ void geodesics::run_fastmarching(che * mesh, const vector<index_t> & sources, co
 		dist[s] = 0;
 		if(clusters) clusters[s] = ++c;
 		color[s] = RED;
-		Q.push(make_pair(dist[s], s));
+		Q.update(s, dist[s]);
 	}
 
 	while(green_count-- && !Q.empty())
 	{
-		while(!Q.empty() && color[Q.top().second] == BLACK)
-			Q.pop();
-
-		if(Q.empty()) break;
-
-		black_i = Q.top().second;
+		black_i = Q.pop();
 		color[black_i] = BLACK;
-		Q.pop();
 		
 		if(dist[black_i] > radio) break;
 
 		sorted_index[n_sorted++] = black_i;
 
-		link_t black_link;
-		mesh->link(black_link, black_i);
-		for(const index_t & he: black_link)
+		for(const index_t & he: mesh->link(black_i))
 		{
 			v = mesh->vt(he);
 
@@ -181,7 +171,7 @@ void geodesics::run_fastmarching(che * mesh, const vector<index_t> & sources, co
 				}
 
 				if(dv < dist[v])
-					Q.push(make_pair(dist[v] = dv, v));
+					Q.update(v, dist[v] = dv);
 			}
 		}
 	}
@@ -258,9 +248,6 @@ void geodesics::run_heat_flow_gpu(che * mesh, const vector<index_t> & sources)
 //d = {NIL, 0, 1} cross edge, next, prev
 distance_t geodesics::update(index_t & d, che * mesh, const index_t & he, vertex & vx)
 {
-	d = NIL;
-
-	a_mat X(3,2);
 	index_t x[3];
 
 	x[0] = mesh->vt(next(he));
@@ -269,72 +256,19 @@ distance_t geodesics::update(index_t & d, che * mesh, const index_t & he, vertex
 
 	vx = mesh->gt(x[2]);
 
-	vertex v[2];
-	v[0] = mesh->gt(x[0]) - vx;
-	v[1] = mesh->gt(x[1]) - vx;
-
-	X(0, 0) = v[0][0];
-	X(1, 0) = v[0][1];
-	X(2, 0) = v[0][2];
-
-	X(0, 1) = v[1][0];
-	X(1, 1) = v[1][1];
-	X(2, 1) = v[1][2];
+	const vertex X[2] = {	mesh->gt(x[0]) - vx,
+							mesh->gt(x[1]) - vx
+							};
 
 	return planar_update(d, X, x, vx);
 }
 
-distance_t geodesics::planar_update(index_t & d, a_mat & X, index_t * x, vertex & vx)
+distance_t geodesics::planar_update(index_t & d, const vertex * X, const index_t * x, vertex & vx)
 {
-	a_mat ones(2,1);
-	ones.ones(2,1);
-
-	a_mat Q;
-	if(!inv_sympd(Q, X.t() * X))
-		return INFINITY;
-
-	a_mat t(2,1);
-
-	t(0) = dist[x[0]];
-	t(1) = dist[x[1]];
-
-	distance_t p;
-	a_mat delta = ones.t() * Q * t;
-	distance_t dis = as_scalar(delta * delta - (ones.t() * Q * ones) * (as_scalar(t.t() * Q * t) - 1));
-
-	if(dis >= 0)
-	{
-		p = delta(0) + sqrt(dis);
-		p /= as_scalar(ones.t() * Q * ones);
-	}
-	else p = INFINITY;
-
-	a_mat n = X * Q * (t - p * ones);
-	a_mat cond = Q * X.t() * n;
-
-	a_vec v(3);
-
-	if(t(0) == INFINITY || t(1) == INFINITY || dis < 0 || (cond(0) >= 0 || cond(1) >= 0))
-	{
-		distance_t dp[2];
-		dp[0] = dist[x[0]] + norm(X.col(0));
-		dp[1] = dist[x[1]] + norm(X.col(1));
-
-		d = dp[1] < dp[0];
-		v = X.col(d);
-		p = dp[d];
-	}
-	else
-	{
-		a_mat A(3,2);
-		A.col(0) = -n;
-		A.col(1) = X.col(1) - X.col(0);
-		a_vec b = -X.col(0);
-		a_mat l =	solve(A, b);
-		v = l(1) * A.col(1) + X.col(0);
-	}
+	vertex v;
+	const distance_t p = fm_planar_update(d, X[0], X[1], dist[x[0]], dist[x[1]], v);
 
-	vx += *((vertex *) v.memptr());
+	vx += v;
 
 	return p;
 }
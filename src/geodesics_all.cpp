@@ -0,0 +1,266 @@
+#include "geodesics_all.h"
+
+#include "geodesics_ptp.h"
+#include "heat_flow.h"
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#include <omp.h>
+
+using namespace std;
+
+
+// geometry processing and shape analysis framework
+namespace gproshan {
+
+
+using checkpoint_t = function<void(const index_t &)>;
+
+/// Max number of distances (sources x vertices) of a batch of the heat method.
+static const size_t heat_batch_size = 1 << 22;
+
+/// Buffers of a thread, reused by all its sources.
+struct all_pairs_ws_t
+{
+	distance_t * dist;
+	distance_t * pdist;
+	distance_t * error;
+	size_t * histogram;
+	toplesets_ws_t toplesets;
+
+	all_pairs_ws_t(const size_t & n_vertices, const size_t & n_bins)
+	{
+		dist = new distance_t[n_vertices];
+		pdist = new distance_t[n_vertices];
+		error = new distance_t[n_vertices];
+		histogram = new size_t[n_bins];
+
+		memset(histogram, 0, sizeof(size_t) * n_bins);
+	}
+
+	all_pairs_ws_t(const all_pairs_ws_t &) = delete;
+
+	~all_pairs_ws_t()
+	{
+		delete [] dist;
+		delete [] pdist;
+		delete [] error;
+		delete [] histogram;
+	}
+};
+
+/// parallel_toplesets_propagation_cpu from the source s with the buffers of the thread, it runs sequentially
+/// in the parallel region of the sources. The distances are in ws.dist.
+static void ptp_source(all_pairs_ws_t & ws, che * mesh, const ptp_coef_t * coef, const index_t & s)
+{
+	mesh->compute_toplesets(ws.toplesets, {s});
+	parallel_toplesets_propagation_cpu(ws.dist, mesh, {s}, {ws.toplesets.limits, ws.toplesets.sorted}, coef, ws.pdist, ws.error);
+}
+
+/// Reductions of the distances dist from the source s.
+static void reduce(all_pairs_t & out, size_t * histogram, const distance_t * dist, const size_t & n_vertices, const index_t & s)
+{
+	double sum = 0;
+	distance_t max_d = 0;
+
+	for(index_t v = 0; v < n_vertices; v++)
+	{
+		sum += dist[v];
+		max_d = max(max_d, dist[v]);
+
+		if(out.histogram && dist[v] < INFINITY)
+			histogram[dist[v] < out.hist_max ? index_t(dist[v] * out.n_bins / out.hist_max) : out.n_bins - 1]++;
+	}
+
+	if(out.mean) out.mean[s] = sum / n_vertices;
+	if(out.max) out.max[s] = max_d;
+}
+
+static void merge_histogram(all_pairs_t & out, const size_t * histogram)
+{
+	if(!out.histogram) return;
+
+	#pragma omp critical
+	for(index_t b = 0; b < out.n_bins; b++)
+		out.histogram[b] += histogram[b];
+}
+
+/// Twice the max finite distance.
+static distance_t diameter_bound(const distance_t * dist, const size_t & n_vertices)
+{
+	distance_t max_d = 0;
+	for(index_t v = 0; v < n_vertices; v++)
+		if(dist[v] < INFINITY)
+			max_d = max(max_d, dist[v]);
+
+	return 2 * max_d;
+}
+
+static void all_pairs_ptp(all_pairs_t & out, che * mesh, const index_t & begin, const index_t & end, const checkpoint_t & checkpoint, const size_t & chunk)
+{
+	const size_t n_vertices = mesh->n_vertices();
+
+	mesh->ring(0);		// the rings are built in parallel, not by the first thread alone
+	ptp_coef_t * coef = ptp_coefficients(mesh);
+
+	if(out.histogram && !out.hist_max)
+	{
+		all_pairs_ws_t ws(n_vertices, 0);
+		ptp_source(ws, mesh, coef, 0);
+		out.hist_max = diameter_bound(ws.dist, n_vertices);
+	}
+
+	#pragma omp parallel
+	{
+		all_pairs_ws_t ws(n_vertices, out.n_bins);
+
+		for(index_t b = begin; b < end; b += chunk)
+		{
+			const index_t e = min<size_t>(end, b + chunk);
+
+			#pragma omp for schedule(dynamic)
+			for(index_t s = b; s < e; s++)
+			{
+				ptp_source(ws, mesh, coef, s);
+				reduce(out, ws.histogram, ws.dist, n_vertices, s);
+			}
+
+			#pragma omp single
+			if(checkpoint) checkpoint(e);
+		}
+
+		merge_histogram(out, ws.histogram);
+	}
+
+	delete [] coef;
+}
+
+static void all_pairs_heat_flow(all_pairs_t & out, che * mesh, const index_t & begin, const index_t & end, const checkpoint_t & checkpoint, const size_t & chunk)
+{
+	const size_t n_vertices = mesh->n_vertices();
+	const size_t batch = min(chunk, max<size_t>(1, heat_batch_size / n_vertices));
+
+	heat_flow_solver solver(mesh);
+	distance_t * dist = new distance_t[batch * n_vertices];
+
+	if(out.histogram && !out.hist_max)
+	{
+		solver.solve(dist, {0});
+		out.hist_max = diameter_bound(dist, n_vertices);
+	}
+
+	vector<index_t> sources;
+	for(index_t b = begin; b < end; b += batch)
+	{
+		sources.clear();
+		for(index_t s = b; s < end && s < b + batch; s++)
+			sources.push_back(s);
+
+		solver.solve(dist, sources);
+
+		#pragma omp parallel
+		{
+			size_t * histogram = new size_t[out.n_bins];
+			memset(histogram, 0, sizeof(size_t) * out.n_bins);
+
+			#pragma omp for
+			for(index_t i = 0; i < sources.size(); i++)
+				reduce(out, histogram, dist + i * n_vertices, n_vertices, sources[i]);
+
+			merge_histogram(out, histogram);
+			delete [] histogram;
+		}
+
+		if(checkpoint) checkpoint(sources.back() + 1);
+	}
+
+	delete [] dist;
+}
+
+#ifdef GPROSHAN_CUDA
+
+/// The GPU methods run a source at a time, the device is not shared.
+static void all_pairs_gpu(all_pairs_t & out, che * mesh, const geodesics::option_t & opt, const index_t & begin, const index_t & end, const checkpoint_t & checkpoint, const size_t & chunk)
+{
+	const size_t n_vertices = mesh->n_vertices();
+
+	toplesets_ws_t ws;
+	distance_t * dist = new distance_t[n_vertices];
+	size_t * histogram = new size_t[out.n_bins];
+	memset(histogram, 0, sizeof(size_t) * out.n_bins);
+
+	double st;
+	auto run = [&](const index_t & s)
+	{
+		if(opt == geodesics::PTP_GPU)
+		{
+			mesh->compute_toplesets(ws, {s});
+			parallel_toplesets_propagation_coalescence_gpu(dist, mesh, {s}, {ws.limits, ws.sorted});
+		}
+		else
+		{
+			distance_t * d = heat_flow_gpu(mesh, {s}, st);
+			memcpy(dist, d, n_vertices * sizeof(distance_t));
+			delete [] d;
+		}
+	};
+
+	if(out.histogram && !out.hist_max)
+	{
+		run(0);
+		out.hist_max = diameter_bound(dist, n_vertices);
+	}
+
+	for(index_t s = begin; s < end; s++)
+	{
+		run(s);
+		reduce(out, histogram, dist, n_vertices, s);
+
+		if(checkpoint && ((s + 1 - begin) % chunk == 0 || s + 1 == end))
+			checkpoint(s + 1);
+	}
+
+	merge_histogram(out, histogram);
+
+	delete [] dist;
+	delete [] histogram;
+}
+
+#endif // GPROSHAN_CUDA
+
+void all_pairs_geodesics(all_pairs_t & out, che * mesh, const geodesics::option_t & opt, const index_t & begin, index_t end, const checkpoint_t & checkpoint, size_t chunk)
+{
+	if(end > mesh->n_vertices()) end = mesh->n_vertices();
+	if(begin >= end) return;
+
+	if(!chunk) chunk = end - begin;
+
+	if(out.histogram && !out.n_bins)
+	{
+		gproshan_error(histogram without bins);
+		return;
+	}
+
+	switch(opt)
+	{
+		case geodesics::PTP_CPU: all_pairs_ptp(out, mesh, begin, end, checkpoint, chunk);
+			break;
+		case geodesics::HEAT_FLOW: all_pairs_heat_flow(out, mesh, begin, end, checkpoint, chunk);
+			break;
+
+#ifdef GPROSHAN_CUDA
+		case geodesics::PTP_GPU:
+		case geodesics::HEAT_FLOW_GPU: all_pairs_gpu(out, mesh, opt, begin, end, checkpoint, chunk);
+			break;
+#endif // GPROSHAN_CUDA
+
+		default: gproshan_error_var(opt);
+	}
+}
+
+
+} // namespace gproshan
+
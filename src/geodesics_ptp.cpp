@@ -1,7 +1,14 @@
 #include "geodesics_ptp.h"
 
+#include "che_stream.h"
+#include "che_view.h"
+
 #include <cmath>
 #include <cstring>
+#include <algorithm>
+#include <memory>
+
+#include <omp.h>
 
 using namespace std;
 
@@ -37,25 +44,40 @@ che * ptp_coalescence(index_t * & inv, che * mesh, const toplesets_t & toplesets
 	return new che(V.data(), toplesets.limits.back(), F.data(), F.size() / che::P);
 }
 
+/// The view of the last mesh of the thread, it is kept between the queries: set() only updates the
+/// previous and the new subsets, without the allocation and the reset of the mesh -> local map.
+static che_view & ptp_view(che * mesh)
+{
+	static thread_local unique_ptr<che_view> view;
+
+	if(!view || !view->is_view_of(mesh))
+		view.reset(new che_view(mesh));
+
+	return *view;
+}
+
+/// The toplesets are processed in a che_view of the sorted vertices, the vertices of the view are the
+/// toplesets order, so that the bands are contiguous ranges of the distance arrays.
 void parallel_toplesets_propagation_coalescence_cpu(const ptp_out_t & ptp_out, che * mesh, const vector<index_t> & sources, const toplesets_t & toplesets)
 {
 	const size_t n_vertices = mesh->n_vertices();
 
-	index_t * inv = nullptr;
-	mesh = ptp_coalescence(inv, mesh, toplesets);
+	che_view & view = ptp_view(mesh);
+	view.set(toplesets.index, toplesets.limits.back());
+	const che_view * vmesh = &view;
 
 	// ------------------------------------------------------
-	distance_t * pdist[2] = {new distance_t[mesh->n_vertices()], new distance_t[mesh->n_vertices()]};
-	distance_t * error = new distance_t[mesh->n_vertices()];
+	distance_t * pdist[2] = {new distance_t[view.n_vertices()], new distance_t[view.n_vertices()]};
+	distance_t * error = new distance_t[view.n_vertices()];
 
 	#pragma omp parallel for
-	for(index_t v = 0; v < mesh->n_vertices(); v++)
+	for(index_t v = 0; v < view.n_vertices(); v++)
 		pdist[0][v] = pdist[1][v] = INFINITY;
 
 	for(index_t i = 0; i < sources.size(); i++)
 	{
-		pdist[0][inv[sources[i]]] = pdist[1][inv[sources[i]]] = 0;
-		if(ptp_out.clusters) ptp_out.clusters[inv[sources[i]]] = i + 1;
+		pdist[0][view.local_v(sources[i])] = pdist[1][view.local_v(sources[i])] = 0;
+		if(ptp_out.clusters) ptp_out.clusters[view.local_v(sources[i])] = i + 1;
 	}
 
 	index_t d = 0;
@@ -80,15 +102,15 @@ void parallel_toplesets_propagation_coalescence_cpu(const ptp_out_t & ptp_out, c
 			pdist[!d][v] = pdist[d][v];
 
 			distance_t p;
-			for_star(he, mesh, v)
+			for_star(he, vmesh, v)
 			{
-				p = update_step(mesh, pdist[d], he);
+				p = update_step(vmesh, pdist[d], he);
 				if(p < pdist[!d][v])
 				{
 					pdist[!d][v] = p;
 
 					if(ptp_out.clusters)
-						ptp_out.clusters[v] = ptp_out.clusters[mesh->vt(prev(he))] != NIL ? ptp_out.clusters[mesh->vt(prev(he))] : ptp_out.clusters[mesh->vt(next(he))];
+						ptp_out.clusters[v] = ptp_out.clusters[vmesh->vt(prev(he))] != NIL ? ptp_out.clusters[vmesh->vt(prev(he))] : ptp_out.clusters[vmesh->vt(next(he))];
 				}
 			}
 		}
@@ -110,23 +132,47 @@ void parallel_toplesets_propagation_coalescence_cpu(const ptp_out_t & ptp_out, c
 	
 	#pragma omp parallel for
 	for(index_t v = 0; v < n_vertices; v++)
-		ptp_out.dist[v] = inv[v] != NIL ? pdist[!d][inv[v]] : INFINITY;
+		ptp_out.dist[v] = view.local_v(v) != NIL ? pdist[!d][view.local_v(v)] : INFINITY;
 	
 	delete [] error;
 	delete [] pdist[0];
 	delete [] pdist[1];
-	delete [] inv;
-	delete mesh;
 }
 
-void parallel_toplesets_propagation_cpu(const ptp_out_t & ptp_out, che * mesh, const vector<index_t> & sources, const toplesets_t & toplesets)
+/// f(first, last) on the ranges of the threads of [begin, end), it returns the sum of the results. Inside a
+/// parallel region (e.g. a source by thread) it is f(begin, end): a nested region by band would cost more
+/// than the band.
+template <class F>
+static index_t ptp_for(const index_t & begin, const index_t & end, const F & f)
 {
-	distance_t * pdist[2] = {ptp_out.dist, new distance_t[mesh->n_vertices()]};
-	distance_t * error = new distance_t[mesh->n_vertices()];
+	if(omp_get_level()) return f(begin, end);
 
-	#pragma omp parallel for
-	for(index_t v = 0; v < mesh->n_vertices(); v++)
-		pdist[0][v] = pdist[1][v] = INFINITY;
+	index_t count = 0;
+
+	#pragma omp parallel reduction(+: count)
+	{
+		const size_t n = end - begin;
+		const size_t t = omp_get_thread_num();
+		const size_t n_threads = omp_get_num_threads();
+
+		count += f(begin + n * t / n_threads, begin + n * (t + 1) / n_threads);
+	}
+
+	return count;
+}
+
+void parallel_toplesets_propagation_cpu(const ptp_out_t & ptp_out, che * mesh, const vector<index_t> & sources, const toplesets_t & toplesets, const ptp_coef_t * coef, distance_t * pdist_buffer, distance_t * error_buffer)
+{
+	distance_t * pdist[2] = {ptp_out.dist, pdist_buffer ? pdist_buffer : new distance_t[mesh->n_vertices()]};
+	distance_t * error = error_buffer ? error_buffer : new distance_t[mesh->n_vertices()];
+
+	ptp_for(0, mesh->n_vertices(), [&](const index_t & first, const index_t & last)
+	{
+		for(index_t v = first; v < last; v++)
+			pdist[0][v] = pdist[1][v] = INFINITY;
+
+		return 0;
+	});
 
 	for(index_t i = 0; i < sources.size(); i++)
 	{
@@ -150,22 +196,143 @@ void parallel_toplesets_propagation_cpu(const ptp_out_t & ptp_out, che * mesh, c
 		end = toplesets.limits[j];
 		n_cond = toplesets.limits[i + 1] - start;
 		
-		#pragma omp parallel for
-		for(index_t vi = start; vi < end; vi++)
+		ptp_for(start, end, [=](const index_t & first, const index_t & last)
 		{
-			const index_t & v = toplesets.index[vi];
-			pdist[!d][v] = pdist[d][v];
+			const distance_t * dist = pdist[d];
+			distance_t * new_dist = pdist[!d];
 
-			distance_t p;
-			for_star(he, mesh, v)
+			for(index_t vi = first; vi < last; vi++)
 			{
-				p = update_step(mesh, pdist[d], he);
-				if(p < pdist[!d][v])
+				const index_t & v = toplesets.index[vi];
+				new_dist[v] = dist[v];
+
+				distance_t p;
+				for_star(he, mesh, v)
 				{
-					pdist[!d][v] = p;
+					p = coef ? update_step(coef[he], dist[mesh->vt(next(he))], dist[mesh->vt(prev(he))])
+							 : update_step(mesh, dist, he);
+					if(p < new_dist[v])
+					{
+						new_dist[v] = p;
+
+						if(ptp_out.clusters)
+							ptp_out.clusters[v] = ptp_out.clusters[mesh->vt(prev(he))] != NIL ? ptp_out.clusters[mesh->vt(prev(he))] : ptp_out.clusters[mesh->vt(next(he))];
+					}
+				}
+			}
 
-					if(ptp_out.clusters)
-						ptp_out.clusters[v] = ptp_out.clusters[mesh->vt(prev(he))] != NIL ? ptp_out.clusters[mesh->vt(prev(he))] : ptp_out.clusters[mesh->vt(next(he))];
+			return 0;
+		});
+
+		count = ptp_for(start, start + n_cond, [=](const index_t & first, const index_t & last)
+		{
+			const distance_t * dist = pdist[d];
+			const distance_t * new_dist = pdist[!d];
+
+			index_t count = 0;
+			for(index_t vi = first; vi < last; vi++)
+			{
+				const index_t & v = toplesets.index[vi];
+				error[vi] = abs(new_dist[v] - dist[v]) / dist[v];
+				count += error[vi] < PTP_TOL;
+			}
+
+			return count;
+		});
+
+		if(n_cond == count) i++;
+		if(j < toplesets.limits.size() - 1) j++;
+
+		d = !d;
+	}
+	
+	if(ptp_out.dist != pdist[!d])
+		memcpy(ptp_out.dist, pdist[!d], mesh->n_vertices() * sizeof(distance_t));
+
+	if(!error_buffer) delete [] error;
+	if(!pdist_buffer) delete [] pdist[1];
+}
+
+/// PTP on a che_stream, the toplesets must be computed by che_stream::compute_toplesets. The vertices of the
+/// band are updated by block: the distances of the block vertices are gathered in a local array and the
+/// owned vertices are updated with the block mesh, which has their full stars. The distances are NAN if a
+/// block is corrupt.
+void parallel_toplesets_propagation_stream(const ptp_out_t & ptp_out, che_stream & mesh, const vector<index_t> & sources, const toplesets_t & toplesets)
+{
+	distance_t * pdist[2] = {ptp_out.dist, new distance_t[mesh.n_vertices()]};
+	distance_t * error = new distance_t[mesh.n_vertices()];
+
+	#pragma omp parallel for
+	for(index_t v = 0; v < mesh.n_vertices(); v++)
+		pdist[0][v] = pdist[1][v] = INFINITY;
+
+	for(index_t i = 0; i < sources.size(); i++)
+	{
+		pdist[0][sources[i]] = pdist[1][sources[i]] = 0;
+		if(ptp_out.clusters) ptp_out.clusters[sources[i]] = i + 1;
+	}
+
+	vector<index_t> band;
+	vector<distance_t> local_dist;
+
+	index_t d = 0;
+	index_t start, end, n_cond, count;
+	index_t i = 1, j = 2;
+
+	// maximum number of iterations
+	index_t iter = 0;
+	index_t max_iter = toplesets.limits.size() << 1;
+	bool corrupt = false;
+
+	while(!corrupt && i < j && iter++ < max_iter)
+	{
+		if(i < (j >> 1)) i = (j >> 1); // K/2 limit band size
+
+		start = toplesets.limits[i];
+		end = toplesets.limits[j];
+		n_cond = toplesets.limits[i + 1] - start;
+
+		band.assign(toplesets.index + start, toplesets.index + end);
+		mesh.sort_by_block(band.data(), band.data() + band.size());
+
+		for(index_t bi = 0, bj; bi < band.size(); bi = bj)
+		{
+			const index_t & b = mesh.owner_v(band[bi]);
+			for(bj = bi + 1; bj < band.size() && mesh.owner_v(band[bj]) == b; bj++);
+
+			shared_ptr<che_stream::block_t> blk = mesh.block(b);
+			if(!blk)
+			{
+				corrupt = true;
+				break;
+			}
+
+			che * bmesh = blk->mesh;
+			const index_t * map = blk->map;
+
+			local_dist.resize(bmesh->n_vertices());
+
+			#pragma omp parallel for
+			for(index_t v = 0; v < bmesh->n_vertices(); v++)
+				local_dist[v] = pdist[d][map[v]];
+
+			#pragma omp parallel for
+			for(index_t vi = bi; vi < bj; vi++)
+			{
+				const index_t & v = band[vi];
+				pdist[!d][v] = pdist[d][v];
+
+				distance_t p;
+				for_star(he, bmesh, mesh.local_v(v))
+				{
+					p = update_step(bmesh, local_dist.data(), he);
+					if(p < pdist[!d][v])
+					{
+						pdist[!d][v] = p;
+
+						if(ptp_out.clusters)
+							ptp_out.clusters[v] = ptp_out.clusters[map[bmesh->vt(prev(he))]] != NIL ? ptp_out.clusters[map[bmesh->vt(prev(he))]] : ptp_out.clusters[map[bmesh->vt(next(he))]];
+					}
 				}
 			}
 		}
@@ -187,78 +354,50 @@ void parallel_toplesets_propagation_cpu(const ptp_out_t & ptp_out, che * mesh, c
 
 		d = !d;
 	}
-	
+
 	delete [] error;
-	
+
 	if(ptp_out.dist != pdist[!d])
 	{
-		memcpy(ptp_out.dist, pdist[!d], mesh->n_vertices() * sizeof(distance_t));
+		memcpy(ptp_out.dist, pdist[!d], mesh.n_vertices() * sizeof(distance_t));
 		delete [] pdist[!d];
 	}
 	else delete [] pdist[d];
+
+	if(corrupt)
+		fill(ptp_out.dist, ptp_out.dist + mesh.n_vertices(), NAN);
 }
 
-distance_t update_step(che * mesh, const distance_t * dist, const index_t & he)
+ptp_coef_t * ptp_coefficients(che * mesh)
 {
-	index_t x[3];
-	x[0] = mesh->vt(next(he));
-	x[1] = mesh->vt(prev(he));
-	x[2] = mesh->vt(he);
-
-	vertex X[2];
-	X[0] = mesh->gt(x[0]) - mesh->gt(x[2]);
-	X[1] = mesh->gt(x[1]) - mesh->gt(x[2]);
-
-	distance_t t[2];
-	t[0] = dist[x[0]];
-	t[1] = dist[x[1]];
-
-	distance_t q[2][2];
-	q[0][0] = (X[0], X[0]);
-	q[0][1] = (X[0], X[1]);
-	q[1][0] = (X[1], X[0]);
-	q[1][1] = (X[1], X[1]);
-
-	distance_t det = q[0][0] * q[1][1] - q[0][1] * q[1][0];
-	distance_t Q[2][2];
-	Q[0][0] = q[1][1] / det;
-	Q[0][1] = -q[0][1] / det;
-	Q[1][0] = -q[1][0] / det;
-	Q[1][1] = q[0][0] / det;
-
-	distance_t delta = t[0] * (Q[0][0] + Q[1][0]) + t[1] * (Q[0][1] + Q[1][1]);
-	distance_t dis = delta * delta -
-					(Q[0][0] + Q[0][1] + Q[1][0] + Q[1][1]) * 
-					(t[0] * t[0] * Q[0][0] + t[0] * t[1] * (Q[1][0] + Q[0][1]) + t[1] * t[1] * Q[1][1] - 1);
-
-	distance_t p = (delta + sqrt(dis)) / (Q[0][0] + Q[0][1] + Q[1][0] + Q[1][1]);
-
-	distance_t tp[2];
-	tp[0] = t[0] - p;
-	tp[1] = t[1] - p;
-
-	vertex n(tp[0] * (X[0][0]*Q[0][0] + X[1][0]*Q[1][0]) + tp[1] * (X[0][0]*Q[0][1] + X[1][0]*Q[1][1]),
-			 tp[0] * (X[0][1]*Q[0][0] + X[1][1]*Q[1][0]) + tp[1] * (X[0][1]*Q[0][1] + X[1][1]*Q[1][1]),
-			 tp[0] * (X[0][2]*Q[0][0] + X[1][2]*Q[1][0]) + tp[1] * (X[0][2]*Q[0][1] + X[1][2]*Q[1][1]) );
-
-	distance_t cond[2];
-	cond[0] = (X[0] , n);
-	cond[1] = (X[1] , n);
-
-	distance_t c[2];
-	c[0] = cond[0] * Q[0][0] + cond[1] * Q[0][1];
-	c[1] = cond[0] * Q[1][0] + cond[1] * Q[1][1];
-
-	if(t[0] == INFINITY || t[1] == INFINITY || dis < 0 || c[0] >= 0 || c[1] >= 0)
-	{
-		distance_t dp[2];
-		dp[0] = dist[x[0]] + *X[0];
-		dp[1] = dist[x[1]] + *X[1];
+	ptp_coef_t * coef = new ptp_coef_t[mesh->n_half_edges()];
 
-		p = dp[dp[1] < dp[0]];
-	}
+	#pragma omp parallel for
+	for(index_t he = 0; he < mesh->n_half_edges(); he++)
+		coef[he] = ptp_coef_t(mesh->gt_vt(next(he)) - mesh->gt_vt(he), mesh->gt_vt(prev(he)) - mesh->gt_vt(he));
+
+	return coef;
+}
 
-	return p;
+// mesh is a che or a che_view
+template <class T>
+static distance_t update_step_t(const T * mesh, const distance_t * dist, const index_t & he)
+{
+	const index_t x0 = mesh->vt(next(he));
+	const index_t x1 = mesh->vt(prev(he));
+	const vertex & x = mesh->gt(mesh->vt(he));
+
+	return update_step(ptp_coef_t(mesh->gt(x0) - x, mesh->gt(x1) - x), dist[x0], dist[x1]);
+}
+
+distance_t update_step(che * mesh, const distance_t * dist, const index_t & he)
+{
+	return update_step_t(mesh, dist, he);
+}
+
+distance_t update_step(const che_view * mesh, const distance_t * dist, const index_t & he)
+{
+	return update_step_t(mesh, dist, he);
 }
 
 void normalize_ptp(distance_t * dist, const size_t & n)
@@ -3,6 +3,8 @@
 #include "laplacian.h"
 
 #include <cassert>
+#include <cmath>
+#include <algorithm>
 
 using namespace std;
 
@@ -61,6 +63,101 @@ distance_t * heat_flow(che * mesh, const vector<index_t> & sources, double & sol
 	return dist;
 }
 
+heat_flow_solver::heat_flow_solver(che * shape): mesh(shape)
+{
+	// step
+	real_t dt = mesh->mean_edge();
+	dt *= dt;
+
+	a_sp_mat L, A;
+	laplacian(mesh, L, A);
+
+	// make L positive-definite
+	L += 1.0e-8 * A;
+
+	// heat flow for short interval
+	A += dt * L;
+
+	cholmod_l_start(&context);
+
+	cholmod_sparse * cA = arma_2_cholmod(A, &context);
+	cA->stype = 1;
+	heat = cholmod_l_analyze(cA, &context);
+	cholmod_l_factorize(cA, heat, &context);
+	cholmod_l_free_sparse(&cA, &context);
+
+	cholmod_sparse * cL = arma_2_cholmod(L, &context);
+	cL->stype = 1;
+	poisson = cholmod_l_analyze(cL, &context);
+	cholmod_l_factorize(cL, poisson, &context);
+	cholmod_l_free_sparse(&cL, &context);
+}
+
+heat_flow_solver::~heat_flow_solver()
+{
+	cholmod_l_free_factor(&heat, &context);
+	cholmod_l_free_factor(&poisson, &context);
+	cholmod_l_finish(&context);
+}
+
+double heat_flow_solver::solve(distance_t * dist, const vector<index_t> & sources)
+{
+	const size_t n = mesh->n_vertices();
+	const size_t k = sources.size();
+	if(!k) return 0;
+
+	// impulse signals
+	cholmod_dense * u0 = cholmod_l_zeros(n, k, CHOLMOD_REAL, &context);
+	for(index_t i = 0; i < k; i++)
+		((real_t *) u0->x)[i * n + sources[i]] = 1;
+
+	double solve_time = 0, time;
+
+	TIC(time)
+	cholmod_dense * u = cholmod_l_solve(CHOLMOD_A, heat, u0, &context);
+	TOC(time)
+	solve_time += time;
+
+	// extract geodesics
+	a_mat U((real_t *) u->x, n, k, false);
+	a_mat div(n, k);
+
+	#pragma omp parallel for
+	for(index_t i = 0; i < k; i++)
+	{
+		a_mat div_i(div.colptr(i), n, 1, false);
+		compute_divergence(mesh, a_mat(U.colptr(i), n, 1, false), div_i);
+	}
+
+	cholmod_dense * cdiv = arma_2_cholmod(div, &context);
+
+	TIC(time)
+	cholmod_dense * phi = cholmod_l_solve(CHOLMOD_A, poisson, cdiv, &context);
+	TOC(time)
+	solve_time += time;
+
+	#pragma omp parallel for
+	for(index_t i = 0; i < k; i++)
+	{
+		const real_t * phi_i = (real_t *) phi->x + i * n;
+		distance_t * dist_i = dist + i * n;
+
+		real_t min_val = INFINITY;
+		for(index_t v = 0; v < n; v++)
+			min_val = min(min_val, phi_i[v]);
+
+		for(index_t v = 0; v < n; v++)
+			dist_i[v] = 0.5 * (phi_i[v] - min_val);
+	}
+
+	cholmod_l_free_dense(&u0, &context);
+	cholmod_l_free_dense(&u, &context);
+	cholmod_l_free_dense(&cdiv, &context);
+	cholmod_l_free_dense(&phi, &context);
+
+	return solve_time;
+}
+
 #ifdef GPROSHAN_CUDA
 
 distance_t * heat_flow_gpu(che * mesh, const vector<index_t> & sources, double & solve_time)
@@ -117,7 +214,7 @@ void compute_divergence(che * mesh, const a_mat & u, a_mat & div)
 		sum = 0;
 		for_star(he, mesh, v)
 			sum += (
-					mesh->normal_he(he) * ( mesh->gt_vt(prev(he)) - mesh->gt_vt(next(he)) ) ,
+					mesh->normal_trig(trig(he)) * ( mesh->gt_vt(prev(he)) - mesh->gt_vt(next(he)) ) ,
 					- mesh->gradient_he(he, u.memptr()) 
 					);
 	}
@@ -150,6 +247,7 @@ double solve_positive_definite(a_mat & x, const a_sp_mat & A, const a_mat & b, c
 	cholmod_l_free_factor(&L, context);
 	cholmod_l_free_sparse(&cA, context);
 	cholmod_l_free_dense(&cb, context);
+	cholmod_l_free_dense(&cx, context);
 
 	return solve_time;
 }
@@ -1,5 +1,7 @@
 #include "laplacian.h"
 
+#include "che_soa.h"
+
 using namespace std;
 using namespace Eigen;
 
@@ -19,6 +21,13 @@ void laplacian(che * mesh, a_sp_mat & L, a_sp_mat & A)
 	arma::umat SI(2, n_edges);
 	a_vec SV(n_edges);
 
+	real_t * cot = new real_t[mesh->n_half_edges()];
+	area_t * areas = new area_t[mesh->n_faces()];
+
+	che_soa soa(mesh);
+	soa.cotans(cot);
+	soa.area_trigs(areas);
+
 	#pragma omp parallel for
 	for(index_t e = 0; e < n_edges; e++)
 	{
@@ -35,8 +44,7 @@ void laplacian(che * mesh, a_sp_mat & L, a_sp_mat & A)
 		DV(i) = 1;
 
 		SI(0, e) = SI(1, e) = e;
-		SV(e) = (mesh->cotan(mesh->et(e)) +
-					mesh->cotan(mesh->ot_et(e))) / 2;
+		SV(e) = (cot[mesh->et(e)] + (mesh->ot_et(e) != NIL ? cot[mesh->ot_et(e)] : 0)) / 2;
 	}
 
 	a_sp_mat D(DI, DV, n_edges, n_vertices);
@@ -48,7 +56,16 @@ void laplacian(che * mesh, a_sp_mat & L, a_sp_mat & A)
 
 	#pragma omp parallel for
 	for(index_t v = 0; v < n_vertices; v++)
-		A(v, v) = mesh->area_vertex(v);
+	{
+		area_t area_star = 0;
+		for_star(he, mesh, v)
+			area_star += areas[trig(he)];
+
+		A(v, v) = area_star / 3;
+	}
+
+	delete [] cot;
+	delete [] areas;
 }
 
 void laplacian(che * mesh, sp_mat_e & L, sp_mat_e & A)
@@ -64,20 +81,35 @@ void laplacian(che * mesh, sp_mat_e & L, sp_mat_e & A)
 	D.reserve(VectorXi::Constant(n_edges,2));
 	S.reserve(VectorXi::Constant(n_edges,1));
 
+	real_t * cot = new real_t[mesh->n_half_edges()];
+	area_t * areas = new area_t[mesh->n_faces()];
+
+	che_soa soa(mesh);
+	soa.cotans(cot);
+	soa.area_trigs(areas);
+
 	for(index_t e = 0; e < n_edges; e++)
 	{
 		D.insert(e, mesh->vt(mesh->et(e))) = 1;
 		D.insert(e, mesh->vt(next(mesh->et(e)))) = -1;
 
-		S.insert(e, e) = (mesh->cotan(mesh->et(e)) +
-					mesh->cotan(mesh->ot_et(e))) / 2;
+		S.insert(e, e) = (cot[mesh->et(e)] + (mesh->ot_et(e) != NIL ? cot[mesh->ot_et(e)] : 0)) / 2;
 	}
 
 	L = D.transpose() * S * D;
 
 	A.reserve(VectorXi::Constant(n_vertices, 1));
 	for(index_t v = 0; v < n_vertices; v++)
-		A.insert(v, v) = mesh->area_vertex(v);
+	{
+		area_t area_star = 0;
+		for_star(he, mesh, v)
+			area_star += areas[trig(he)];
+
+		A.insert(v, v) = area_star / 3;
+	}
+
+	delete [] cot;
+	delete [] areas;
 }
 
 size_t eigs_laplacian(a_vec & eigval, a_mat & eigvec, che * mesh, const a_sp_mat & L, const a_sp_mat & A, const size_t & K)
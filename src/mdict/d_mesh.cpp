@@ -223,6 +223,8 @@ void partial_mesh_reconstruction(size_t old_n_vertices, che * mesh, size_t M, ve
 
 	a_vec V(3);
 
+	mesh->edit_vertices();
+
 	#pragma omp parallel for private(V)
 	for(index_t v = old_n_vertices; v < mesh->n_vertices(); v++)
 	{
@@ -279,7 +281,7 @@ void mesh_reconstruction(che * mesh, size_t M, vector<patch> & patches, vector<v
 	distance_t error = 0;
 	#pragma omp parallel for reduction(+: error)
 	for(index_t v = v_i; v < mesh->n_vertices(); v++)
-		error += *(new_vertices[v] - mesh->get_vertex(v));
+		error += *(new_vertices[v] - mesh->gt(v));
 
 	gproshan_debug_var(mesh->n_vertices());
 	error /= mesh->n_vertices();
@@ -364,7 +366,7 @@ void mesh_reconstruction(che * mesh, size_t M, vector<patch_t> & patches, vector
 	distance_t error = 0;
 	#pragma omp parallel for reduction(+: error)
 	for(index_t v = v_i; v < mesh->n_vertices(); v++)
-		error += *(new_vertices[v] - mesh->get_vertex(v));
+		error += *(new_vertices[v] - mesh->gt(v));
 
 	gproshan_debug_var(mesh->n_vertices());
 	error /= mesh->n_vertices();
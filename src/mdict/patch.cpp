@@ -85,7 +85,6 @@ void patch::gather_vertices(che * mesh, const index_t & v, const size_t & n_topl
 	vertices.reserve(expected_nv);
 	memset(toplevel, -1, sizeof(index_t) * mesh->n_vertices());
 	
-	link_t link;
 	toplevel[v] = 0;
 	vertices.push_back(v);
 	for(index_t i = 0; i < vertices.size(); i++)
@@ -94,18 +93,14 @@ void patch::gather_vertices(che * mesh, const index_t & v, const size_t & n_topl
 		if(toplevel[v] == n_toplevels)
 			break;
 		
-		mesh->link(link, v);
-		for(const index_t & he: link)
+		for(const index_t & u: mesh->ring(v))
 		{
-			const index_t & u = mesh->vt(he);
 			if(toplevel[u] == NIL)
 			{
 				vertices.push_back(u);
 				toplevel[u] = toplevel[v] + 1;
 			}
 		}
-
-		link.clear();	
 	}	
 }
 
@@ -124,7 +119,6 @@ void patch::gather_vertices(che * mesh, const index_t & v, const distance_t & ra
 	size_t current_toplevel = 0;
 
 	a_vec p(3);
-	link_t link;
 	toplevel[v] = 0;
 	qvertices.push_back(v);
 	for(index_t i = 0; i < qvertices.size(); i++)
@@ -149,18 +143,14 @@ void patch::gather_vertices(che * mesh, const index_t & v, const distance_t & ra
 			count_toplevel++;
 		}
 		
-		mesh->link(link, v);
-		for(const index_t & he: link)
+		for(const index_t & u: mesh->ring(v))
 		{
-			const index_t & u = mesh->vt(he);
 			if(toplevel[u] == NIL)
 			{
 				qvertices.push_back(u);
 				toplevel[u] = toplevel[v] + 1;
 			}
 		}
-
-		link.clear();	
 	}	
 }
 
@@ -1,11 +1,18 @@
 #include "run_geodesics.h"
 
-#include "che_off.h"
+#include "che_io.h"
 #include "geodesics_ptp.h"
+#include "geodesics_all.h"
 #include "heat_flow.h"
+#include "file_writer.h"
+#include "che_bin.h"
 
 #include <cassert>
 #include <iterator>
+#include <cstring>
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
 #include<iostream>
 #include<fstream>
 
@@ -18,12 +25,25 @@ namespace gproshan {
 
 void run_geodesics(const int & nargs, const char ** args)
 {
+	if(nargs >= 2 && !strcmp(args[1], "--merge"))
+	{
+		merge_dists(nargs, args);
+		return;
+	}
+
 	if(nargs < 4)
 	{
-		printf("./run_geodesics <inputfile> <outputfile> <method>\n");
-		printf("  <inputfile>  :  mesh file in format OFF or OBJ.\n");
+		printf("./run_geodesics <inputfile> <outputfile> <method> [options]\n");
+		printf("  <inputfile>  :  mesh file in any format of che_io (OFF, OBJ, PLY, ...).\n");
 		printf("  <outputfile> :  output file location, will be in text format.\n");
 		printf("  <method> :  1=ptp_cpu, 2=heatflow_cpu, 3=ptp_gpu, 4=heatflow_gpu.\n");
+		printf("  --begin <v> --end <v> :  only the source vertices in [begin, end).\n");
+		printf("  --shard <k>/<n> :  only the k-th of n ranges of source vertices, 0 <= k < n.\n");
+		printf("  --checkpoint <s> :  seconds between checkpoints (default 600).\n");
+		printf("The partial mean distances are saved in <outputfile>.<begin>-<end>.part and a new run of\n");
+		printf("the same mesh, method and range resumes from it. The text output is written when all the\n");
+		printf("vertices are done, the .part files of the shards are assembled with:\n");
+		printf("./run_geodesics --merge <outputfile> <partfiles...>\n");
 
 		return;
 	}
@@ -32,6 +52,29 @@ void run_geodesics(const int & nargs, const char ** args)
 	const char * outputfile = args[2];
 	int method = atoi(args[3]);
 
+	index_t begin = 0, end = NIL;
+	index_t shard = 0, n_shards = 0;
+	double checkpoint_interval = 600;
+
+	for(int i = 4; i < nargs; i++) {
+		if(!strcmp(args[i], "--begin") && i + 1 < nargs) begin = atoll(args[++i]);
+		else if(!strcmp(args[i], "--end") && i + 1 < nargs) end = atoll(args[++i]);
+		else if(!strcmp(args[i], "--shard") && i + 1 < nargs) {
+			unsigned long long k, n;
+			if(sscanf(args[++i], "%llu/%llu", &k, &n) != 2 || k >= n) {
+				gproshan_error_var(args[i]);
+				return;
+			}
+			shard = k;
+			n_shards = n;
+		}
+		else if(!strcmp(args[i], "--checkpoint") && i + 1 < nargs) checkpoint_interval = atof(args[++i]);
+		else {
+			gproshan_error_var(args[i]);
+			return;
+		}
+	}
+
 	int verbosity = 1;
 	int is_test = 0;		// If set, only 100 vertices are really computed. Used to timing different methods.
 	if(is_test == 1) {
@@ -41,134 +84,229 @@ void run_geodesics(const int & nargs, const char ** args)
 	cout << "Handling input file '" << data_path << "', using method " << method << "\n";
 	cout << "Will write to output file '" << outputfile << "'.\n";
 
-	che * mesh;
-	mesh = new che_off(data_path);
+	geodesics::option_t opt;
+	switch(method) {
+		case 1: opt = geodesics::PTP_CPU; break;
+		case 2: opt = geodesics::HEAT_FLOW; break;
+#ifdef GPROSHAN_CUDA
+		case 3: opt = geodesics::PTP_GPU; break;
+		case 4: opt = geodesics::HEAT_FLOW_GPU; break;
+#endif // GPROSHAN_CUDA
+		default:
+			gproshan_error_var(method);
+			return;
+	}
+
+	che * mesh = load_mesh(data_path);
+	if(!mesh) return;
+
 	size_t n_vertices = mesh->n_vertices();
 
 	cout << "Mesh with " << n_vertices << " vertices loaded.\n";
-	distance_t * mean_dists = new distance_t[mesh->n_vertices()];	// mean distance from one vertex to all others. kept over all iterations, one value added in each iteration.
+	distance_t * mean_dists = new distance_t[mesh->n_vertices()];	// mean distance from one vertex to all others, NAN if it is not computed.
+	distance_t * max_dists = new distance_t[mesh->n_vertices()];	// max distance from one vertex to all others.
+
+	if(n_shards) {
+		begin = n_vertices * shard / n_shards;
+		end = n_vertices * (shard + 1) / n_shards;
+	}
 
-	index_t verts_to_compute = n_vertices;
 	if(is_test == 1) {
-		verts_to_compute = 100;
+		end = min<size_t>(end, begin + 100);
 	}
 
-	for(index_t source_vert = 0; source_vert < verts_to_compute; source_vert++) {
-		vector <index_t> source = { source_vert };
+	end = min<size_t>(end, n_vertices);
+	begin = min(begin, end);
+
+	for(index_t v = 0; v < n_vertices; v++)
+		mean_dists[v] = NAN;
+
+	checkpoint_header_t header = {};
+	header.method = method;
+	header.begin = begin;
+	header.end = end;
+	header.n_vertices = n_vertices;
+	header.mesh_hash = che_bin::hash(mesh);
+
+	// resume: the chunks are done in order, the sources before the first NAN of the range are done
+	const string partfile = string(outputfile) + "." + to_string(begin) + "-" + to_string(end) + ".part";
+	if(ifstream(partfile).good()) {
+		checkpoint_header_t part_header;
+		vector<distance_t> part;
+		if(read_checkpoint(partfile, part_header, part) && part_header.method == header.method
+			&& part_header.begin == header.begin && part_header.end == header.end
+			&& part_header.n_vertices == header.n_vertices && part_header.mesh_hash == header.mesh_hash) {
+			copy(part.begin(), part.end(), mean_dists);
+			cout << "Resuming from checkpoint '" << partfile << "'.\n";
+		}
+		else {
+			gproshan_error(the checkpoint is not valid or it is of a different mesh or method);
+			gproshan_error_var(partfile);
+			delete [] mean_dists;
+			delete [] max_dists;
+			delete mesh;
+			return;
+		}
+	}
 
-		index_t * toplesets = new index_t[n_vertices];
-		index_t * sorted_index = new index_t[n_vertices];
-		vector<index_t> limits;
-  	//	cout << "Computing toplesets\n";
+	index_t resume = begin;
+	while(resume < end && !isnan(mean_dists[resume])) resume++;
 
-		double st;
-		distance_t * dist;
+	printf("Computing the source vertices [%zu, %zu), %zu done.\n", (size_t)begin, (size_t)end, (size_t)(resume - begin));
 
-		if(method == 1 || method == 3) {
-			//mesh = new che_off(data_path);
-			mesh->compute_toplesets(toplesets, sorted_index, limits, source);
-		}
+	// all the sources in parallel, only the mean and max distances of each source are kept
+	all_pairs_t all_pairs;
+	all_pairs.mean = mean_dists;
+	all_pairs.max = max_dists;
 
+	double time, last_checkpoint;
+	TIC(time)
+	last_checkpoint = time;
 
+	auto checkpoint = [&](const index_t & e) {
+		if(omp_get_wtime() - last_checkpoint < checkpoint_interval) return;
 
-		if(method == 1) {
-			//cout << "Running ptp_cpu method\n";
-			/* run_ptp_cpu(mesh, source, {limits, sorted_index}); */
-			dist = new distance_t[mesh->n_vertices()];	// geodesic distances of the source vertex to all other vertices. reset in each iteration.
-			const toplesets_t & toplesets2 = {limits, sorted_index};
-			parallel_toplesets_propagation_cpu(dist, mesh, source, toplesets2);
-		}
+		const bool saved = save_checkpoint(partfile, header, mean_dists);
+		last_checkpoint = omp_get_wtime();
 
-		if(method == 2) {
-			dist = nullptr;
-			if(dist) delete [] dist;
-			dist = heat_flow(mesh, source, st);
+		if(saved && verbosity > 0) {
+			printf("  Checkpoint at source vertex %zu.\n", (size_t)e);
 		}
+	};
 
-#ifdef GPROSHAN_CUDA
-		if(method == 3) {
-		   dist = new distance_t[mesh->n_vertices()];
-			 const toplesets_t & toplesets2 = {limits, sorted_index};
-	     parallel_toplesets_propagation_coalescence_gpu(dist, mesh, source, toplesets2);
+	all_pairs_geodesics(all_pairs, mesh, opt, resume, end, checkpoint, 64 * omp_get_max_threads());
+	TOC(time)
+
+	if(verbosity > 0) {
+		distance_t diameter = 0;
+		for(index_t v = resume; v < end; v++)
+			diameter = max(diameter, max_dists[v]);
+
+		printf("Computed %zu source vertices in %.3f s, diameter %f.\n", (size_t)(end - resume), time, diameter);
+	}
+
+	if(is_test == 1) {
+		printf("Mean geodesic distances for first 3 verts were: %f %f %f.\n", mean_dists[0], mean_dists[1], mean_dists[2]);
+	}
+
+	if(count_if(mean_dists, mean_dists + n_vertices, [](const distance_t & d) { return isnan(d); })) {
+		if(save_checkpoint(partfile, header, mean_dists))
+			printf("Saved partial mean distances to file '%s', assemble the shards with --merge.\n", partfile.c_str());
+	}
+	else {
+		save_dists(outputfile, mean_dists, n_vertices);
+		printf("Saved mean distances to file '%s'.\n", outputfile);
+		remove(partfile.c_str());
+	}
+
+	delete [] mean_dists;
+	delete [] max_dists;
+	delete mesh;
+}
+
+void merge_dists(const int & nargs, const char ** args)
+{
+	if(nargs < 4)
+	{
+		printf("./run_geodesics --merge <outputfile> <partfiles...>\n");
+		return;
+	}
+
+	const char * outputfile = args[2];
+
+	vector<distance_t> mean_dists, part;
+	checkpoint_header_t first, header;
 
+	for(int i = 3; i < nargs; i++) {
+		if(!read_checkpoint(args[i], header, part)) {
+			gproshan_error_var(args[i]);
+			return;
 		}
 
+		if(i == 3) {
+			first = header;
+			mean_dists.assign(header.n_vertices, NAN);
+		}
 
-		if(method == 4) {
-		    dist = nullptr;
-	      if(dist) delete [] dist;
-	      dist = heat_flow_gpu(mesh, source, st);
+		if(header.n_vertices != first.n_vertices || header.mesh_hash != first.mesh_hash || header.method != first.method) {
+			gproshan_error(the shards are of different meshes or methods);
+			gproshan_error_var(args[i]);
+			return;
 		}
-#else
-#endif // GPROSHAN_CUDA
 
-		// Compute and save mean distance
-		double dist_sum = 0.0;
-	  double dist_mean_this_vert;
-	  for (size_t vidx = 0; vidx < n_vertices; vidx++) {
-					//printf("Dist to vert %d is: %f\n", vidx, dist[vidx]);
-		    dist_sum += dist[vidx];
-	  }
-		dist_mean_this_vert = dist_sum / (double)n_vertices;
-//		printf("Mean dist is %f.\n", dist_mean);
-	  mean_dists[source_vert] = dist_mean_this_vert;
+		// only the sources of the range of the shard
+		for(size_t v = header.begin; v < header.end && v < part.size(); v++)
+			if(!isnan(part[v])) mean_dists[v] = part[v];
+	}
 
+	const size_t n_missing = count_if(mean_dists.begin(), mean_dists.end(), [](const distance_t & d) { return isnan(d); });
+	if(n_missing) {
+		gproshan_error_var(n_missing);
+		return;
+	}
 
+	save_dists(outputfile, mean_dists.data(), mean_dists.size());
+	printf("Merged %d files, saved mean distances to file '%s'.\n", nargs - 3, outputfile);
+}
 
-	// FREE MEMORY
+static const char checkpoint_magic[8] = {'G', 'P', 'G', 'E', 'O', 'C', 'K', '\0'};
+static const uint32_t checkpoint_version = 1;
 
-		//delete mesh;
-		delete [] toplesets;
-		delete [] sorted_index;
-    if (dist) delete [] dist;
+/// The checkpoint replaces the previous one only when it is completely written and synced to disk (see
+/// write_file_durable), so that a crash or a write error does not lose it.
+bool save_checkpoint(const string & partfile, const checkpoint_header_t & header, const distance_t * mean_dists)
+{
+	checkpoint_header_t h = header;
+	memcpy(h.magic, checkpoint_magic, sizeof(h.magic));
+	h.version = checkpoint_version;
+	h.size_real = sizeof(distance_t);
 
-		if(verbosity > 0) {
-			if(source_vert % 100 == 0) {
-			    printf("  At source vertex %d.\n", (int)source_vert);
-			}
-			else if (source_vert % 1000 == 0) {
-			    printf("At source vertex %d.\n", (int)source_vert);
-	    }
-	  }
+	out_buffer out;
+	out.reserve(sizeof(checkpoint_header_t) + h.n_vertices * sizeof(distance_t));
+	out.write(&h, sizeof(checkpoint_header_t));
+	out.write(mean_dists, h.n_vertices * sizeof(distance_t));
 
+	return write_file_durable(partfile, out.data(), out.size());
+}
+
+bool read_checkpoint(const string & partfile, checkpoint_header_t & header, vector<distance_t> & mean_dists)
+{
+	ifstream is(partfile, ios::binary);
 
+	if(!is.read((char *) &header, sizeof(checkpoint_header_t)) || memcmp(header.magic, checkpoint_magic, sizeof(header.magic))
+		|| header.version != checkpoint_version || header.size_real != sizeof(distance_t) || header.begin > header.end)
+	{
+		gproshan_error(not a run_geodesics checkpoint or written by a different version);
+		return false;
 	}
 
-	if(is_test == 1) {
-		printf("Mean geodesic distances for first 3 verts were: %f %f %f.\n", mean_dists[0], mean_dists[1], mean_dists[2]);
+	mean_dists.resize(header.n_vertices);
+	if(!is.read((char *) mean_dists.data(), mean_dists.size() * sizeof(distance_t)))
+	{
+		gproshan_error(truncated checkpoint);
+		return false;
 	}
-	save_dists(outputfile, mean_dists, n_vertices);
-  printf("Saved mean distances to file '%s'.\n", outputfile);
 
+	return true;
 }
 
 
 void save_dists(const char * outfile, distance_t * mean_dists, size_t num_dists) {
-	int save_method = 2;   // 1=binary, 2=CSV
+	int save_method = 2;   // 1=binary (field sidecar, see write_field), 2=CSV
 	if(save_method == 1) {
-		ofstream wf(outfile, ios::out | ios::binary);
-	   if(!wf) {
-	      cout << "Cannot open distance output file." << endl;
-	   }
-	   for(size_t i = 0; i < num_dists; i++)
-	      wf.write((char *) &mean_dists[i], sizeof(distance_t));
-	   wf.close();
-	   if(!wf.good()) {
-	      cout << "Error occurred while writing distances." << endl;
-	   }
- }
- if(save_method == 2) {
-	 fstream f;
-    f.open(outfile, ios::out);
-    for(size_t i=0; i < num_dists; i++) {
-			if(i < (num_dists-1)) {
-    		f << mean_dists[i] << ';';
-			} else {
-				f << mean_dists[i];
-			}
-		}
-    f.close();
- }
+		if(!write_field(outfile, mean_dists, num_dists))
+			cout << "Error occurred while writing distances." << endl;
+	}
+	if(save_method == 2) {
+		file_writer f(outfile);
+		f.write_records(num_dists, [&](out_buffer & out, const index_t & i)
+		{
+			out << mean_dists[i];
+			if(i < num_dists - 1) out << ';';
+		});
+		if(!f.flush())
+			cout << "Error occurred while writing distances." << endl;
+	}
 }
 
 
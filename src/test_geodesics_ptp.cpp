@@ -1,6 +1,6 @@
 #include "test_geodesics_ptp.h"
 
-#include "che_off.h"
+#include "che_io.h"
 #include "geodesics_ptp.h"
 #include "heat_flow.h"
 
@@ -40,14 +40,26 @@ void main_test_geodesics_ptp(const int & nargs, const char ** args)
 	const char * pbtime = "& %6s %6.3lfs ";
 	const char * pberror = "& %6s %6.2lf\\%% ";
 
-	string filename;
-	while(cin >> filename)
+	// the meshes are loaded concurrently before the tests, so that the loading does not disturb the timings
+	vector<string> filenames, files;
+	for(string filename; cin >> filename; )
 	{
+		filenames.push_back(filename);
+		files.push_back(data_path + filename + ".off");
+	}
+
+	vector<che *> meshes = load_meshes(files);
+
+	for(index_t m = 0; m < meshes.size(); m++)
+	{
+		const string & filename = filenames[m];
 		gproshan_debug_var(filename);
-		
+
+		che * mesh = meshes[m];
+		if(!mesh) continue;
+
 		vector<index_t> source = { 0 };
 		
-		che * mesh = new che_off(data_path + filename + ".off");
 		size_t n_vertices = mesh->n_vertices();
 		
 		index_t * toplesets = new index_t[n_vertices];
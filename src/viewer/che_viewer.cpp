@@ -119,16 +119,31 @@ void che_viewer::update_vbo()
 	// INDEXES
 	if(mesh->n_faces())
 	{
+	#ifdef INDEX_64
+		// OpenGL element indexes are 32 bits
+		GLuint * indices = new GLuint[mesh->n_half_edges()];
+
+		#pragma omp parallel for
+		for(index_t he = 0; he < mesh->n_half_edges(); he++)
+			indices[he] = mesh->vt(he);
+
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo[3]);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh->n_half_edges() * sizeof(GLuint), indices, GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+		delete [] indices;
+	#else
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo[3]);
 		glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh->n_half_edges() * sizeof(index_t), &mesh->vt(0), GL_STATIC_DRAW);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	#endif
 	}
 	else
 	{
-		index_t * indices = new index_t[_n_vertices];
+		GLuint * indices = new GLuint[_n_vertices];
 		iota(indices, indices + _n_vertices, 0);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo[3]);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, _n_vertices * sizeof(index_t), indices, GL_STATIC_DRAW);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, _n_vertices * sizeof(GLuint), indices, GL_STATIC_DRAW);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
 		delete [] indices;
@@ -198,7 +213,7 @@ void che_viewer::draw_normal_field()
 	for(index_t v = 0; v < _n_vertices; v++)
 	{
 		vertex n = factor * normals[v];
-		vertex a = mesh->get_vertex(v);
+		vertex a = mesh->gt(v);
 		vertex b = a + n;
 
 		glVertex3v(&a[0]);
@@ -224,7 +239,7 @@ void che_viewer::draw_gradient_field()
 		vertex g = h * mesh->gradient_he(f * che::P, colors);
 		vertex a = mesh->barycenter(f);
 		vertex b = a + g;
-		vertex n = mesh->normal_he(f * che::P);
+		const vertex & n = mesh->normal_trig(f);
 
 		vertex v = b - a;
 		vertex v90 = n * v;
@@ -314,6 +329,8 @@ void che_viewer::translate(const vertex & p)
 {
 	v_translate = p;
 
+	mesh->edit_vertices();
+
 	#pragma omp parallel for
 	for(index_t v = 0; v < mesh->n_vertices(); v++)
 		mesh->get_vertex(v) += v_translate;
@@ -8,9 +8,8 @@
 #include <vector>
 #include <cassert>
 
-#include <che_off.h>
-#include <che_obj.h>
-#include <che_ply.h>
+#include <che_io.h>
+#include <file_writer.h>
 
 using namespace std;
 
@@ -312,16 +311,17 @@ void viewer::menu_save_mesh()
 {
 	gproshan_log(APP_VIEWER);
 	
-	gproshan_log(format: [off obj ply]);
+	gproshan_log(format: [off obj ply che gpz]);
 	
 	string format; cin >> format;
 	string file = mesh()->filename() + "_new";
 	
-	if(format == "off") che_off::write_file(mesh(), file);
-	if(format == "obj") che_obj::write_file(mesh(), file);
-	if(format == "ply") che_ply::write_file(mesh(), file);
+	if(!write_mesh(mesh(), file, format)) return;
 
 	cerr << "saved: " << file + "." + format << endl;
+
+	if(write_field(file + ".colors", &mesh().color(0), mesh()->n_vertices()))
+		cerr << "saved: " << file + ".colors" << endl;
 }
 
 void viewer::menu_exit()